@@ -0,0 +1,465 @@
+/*
+ * MIT License
+ * 
+ * Copyright (c) 2019 Tarik02
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ */
+
+#include <libcsv.h>
+
+#include <algorithm>
+#include <cinttypes>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+
+/* Prevents compiler from optimizing out results */
+static volatile uint64_t sink;
+
+
+template<typename F>
+static void run(const char *name, size_t count, F &&body) {
+  auto begin = chrono::steady_clock::now();
+  body();
+  auto end = chrono::steady_clock::now();
+
+  double seconds = chrono::duration<double>(end - begin).count();
+  printf("%-40s %10.2f ns/op %10.2f Mop/s\n", name, seconds * 1e9 / count, count / seconds / 1e6);
+}
+
+
+static vector<string> generate_integers(size_t count, uint64_t max, bool negative) {
+  mt19937_64 rng(42);
+  vector<string> result;
+  result.reserve(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t value = rng() % max;
+    char buffer[32];
+    if (negative && (rng() & 1)) {
+      snprintf(buffer, sizeof(buffer), "-%" PRIu64, value);
+    } else {
+      snprintf(buffer, sizeof(buffer), "%" PRIu64, value);
+    }
+    result.emplace_back(buffer);
+  }
+
+  return result;
+}
+
+static void bench_integers(const char *label, const vector<string> &values) {
+  string name;
+
+  name = string("sscanf int64 ") + label;
+  run(name.c_str(), values.size(), [&] {
+    uint64_t sum = 0;
+    for (const string &value : values) {
+      int64_t result;
+      int pos = 0;
+      if (sscanf(value.c_str(), "%" SCNd64 "%n", &result, &pos) == 1 && value[pos] == '\0') {
+        sum += result;
+      }
+    }
+    sink = sum;
+  });
+
+  name = string("csv_parse_int64 ") + label;
+  run(name.c_str(), values.size(), [&] {
+    uint64_t sum = 0;
+    for (const string &value : values) {
+      int64_t result;
+      if (csv_parse_int64(value.data(), value.size(), &result)) {
+        sum += result;
+      }
+    }
+    sink = sum;
+  });
+}
+
+static void bench_unsigned(const char *label, const vector<string> &values) {
+  string name;
+
+  name = string("sscanf uint64 ") + label;
+  run(name.c_str(), values.size(), [&] {
+    uint64_t sum = 0;
+    for (const string &value : values) {
+      uint64_t result;
+      int pos = 0;
+      if (sscanf(value.c_str(), "%" SCNu64 "%n", &result, &pos) == 1 && value[pos] == '\0') {
+        sum += result;
+      }
+    }
+    sink = sum;
+  });
+
+  name = string("csv_parse_uint64 ") + label;
+  run(name.c_str(), values.size(), [&] {
+    uint64_t sum = 0;
+    for (const string &value : values) {
+      uint64_t result;
+      if (csv_parse_uint64(value.data(), value.size(), &result)) {
+        sum += result;
+      }
+    }
+    sink = sum;
+  });
+}
+
+static vector<string> generate_doubles(size_t count, int precision) {
+  mt19937_64 rng(42);
+  uniform_real_distribution<double> distribution(-1e6, 1e6);
+  vector<string> result;
+  result.reserve(count);
+
+  for (size_t i = 0; i < count; ++i) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*g", precision, distribution(rng));
+    result.emplace_back(buffer);
+  }
+
+  return result;
+}
+
+static void bench_doubles(const char *label, const vector<string> &values) {
+  string name;
+
+  name = string("sscanf double ") + label;
+  run(name.c_str(), values.size(), [&] {
+    double sum = 0;
+    for (const string &value : values) {
+      double result;
+      int pos = 0;
+      if (sscanf(value.c_str(), "%lf%n", &result, &pos) == 1 && value[pos] == '\0') {
+        sum += result;
+      }
+    }
+    sink = static_cast<uint64_t>(sum);
+  });
+
+  name = string("csv_parse_double ") + label;
+  run(name.c_str(), values.size(), [&] {
+    double sum = 0;
+    for (const string &value : values) {
+      double result;
+      if (csv_parse_double(value.data(), value.size(), &result)) {
+        sum += result;
+      }
+    }
+    sink = static_cast<uint64_t>(sum);
+  });
+
+  name = string("csv_parse_float ") + label;
+  run(name.c_str(), values.size(), [&] {
+    float sum = 0;
+    for (const string &value : values) {
+      float result;
+      if (csv_parse_float(value.data(), value.size(), &result)) {
+        sum += result;
+      }
+    }
+    sink = static_cast<uint64_t>(sum);
+  });
+}
+
+
+/* Synthetic tables, generated with fixed seed, so results are comparable between runs */
+static const size_t table_size = 16 * 1024 * 1024;
+
+static string random_word(mt19937_64 &rng, size_t min, size_t max) {
+  static const char letters[] = "abcdefghijklmnopqrstuvwxyz";
+  size_t length = min + rng() % (max - min + 1);
+  string result(length, ' ');
+
+  for (char &c : result) {
+    c = letters[rng() % 26];
+  }
+
+  return result;
+}
+
+static string generate_table(size_t columns, string (*value)(mt19937_64 &, size_t)) {
+  mt19937_64 rng(42);
+  string result;
+
+  for (size_t i = 0; i < columns; ++i) {
+    result += (i == 0 ? "" : ",") + string("Column") + to_string(i);
+  }
+  result += '\n';
+
+  while (result.size() < table_size) {
+    for (size_t i = 0; i < columns; ++i) {
+      if (i != 0) {
+        result += ',';
+      }
+      result += value(rng, i);
+    }
+    result += '\n';
+  }
+
+  return result;
+}
+
+static string narrow_value(mt19937_64 &rng, size_t column) {
+  return column == 0 ? to_string(rng() % 100000) : random_word(rng, 3, 10);
+}
+
+static string wide_value(mt19937_64 &rng, size_t column) {
+  return column % 2 == 0 ? to_string(rng() % 1000) : random_word(rng, 1, 6);
+}
+
+static string quoted_value(mt19937_64 &rng, size_t) {
+  switch (rng() % 4) {
+  case 0:
+    return "\"" + random_word(rng, 2, 8) + ", " + random_word(rng, 2, 8) + "\"";
+  case 1:
+    return "\"say \"\"" + random_word(rng, 2, 8) + "\"\"\"";
+  case 2:
+    return "\"" + random_word(rng, 2, 8) + "\n" + random_word(rng, 2, 8) + "\"";
+  default:
+    return "\"" + random_word(rng, 4, 12) + "\"";
+  }
+}
+
+static string numeric_value(mt19937_64 &rng, size_t column) {
+  char buffer[32];
+  if (column % 2 == 0) {
+    snprintf(buffer, sizeof(buffer), "%" PRId64, static_cast<int64_t>(rng() % 2000000) - 1000000);
+  } else {
+    snprintf(buffer, sizeof(buffer), "%.6f", static_cast<double>(rng() % 100000000) / 1000);
+  }
+  return buffer;
+}
+
+static string long_value(mt19937_64 &rng, size_t) {
+  return random_word(rng, 1024, 4096);
+}
+
+/* Repeats rows of file up to table_size */
+static string repeat_file(const string &path) {
+  ifstream stream(path);
+  string data {istreambuf_iterator<char>(stream), istreambuf_iterator<char>()};
+  if (data.empty()) {
+    return {};
+  }
+
+  size_t header_end = data.find('\n') + 1;
+  string result = data;
+  while (result.size() < table_size) {
+    result.append(data, header_end, string::npos);
+  }
+
+  return result;
+}
+
+
+/* Best of a few runs: throughput of input bytes and of rows */
+template<typename F>
+static void run_throughput(const string &name, size_t bytes, F &&body) {
+  double best = 0;
+  size_t rows = 0;
+
+  for (int i = 0; i < 3; ++i) {
+    auto begin = chrono::steady_clock::now();
+    rows = body();
+    auto end = chrono::steady_clock::now();
+
+    double seconds = chrono::duration<double>(end - begin).count();
+    if (i == 0 || seconds < best) {
+      best = seconds;
+    }
+  }
+
+  printf("%-40s %10.2f MB/s %10.2f Mrows/s\n", name.c_str(), bytes / best / 1e6, rows / best / 1e6);
+}
+
+/* Adds data by chunks of given size (whole data if 0), returns number of rows */
+static size_t parse_table(const string &data, size_t chunk) {
+  csv_table *table = csv_table_create();
+  size_t rows = 0;
+
+  if (chunk == 0) {
+    chunk = data.size();
+  }
+
+  for (size_t i = 0; i < data.size(); i += chunk) {
+    csv_table_add_data_length(table, data.data() + i, min(chunk, data.size() - i));
+
+    csv_row *row;
+    while ((row = csv_table_next_row(table)) != nullptr) {
+      csv_row_free(row);
+      ++rows;
+    }
+  }
+
+  csv_table_free(table);
+  return rows;
+}
+
+static void bench_table(const char *label, const string &data) {
+  run_throughput(string("csv_table_add_data_length ") + label, data.size(), [&] {
+    return parse_table(data, 0);
+  });
+}
+
+static void bench_chunks(const char *label, const string &data) {
+  /* 1-byte chunks are slow, so the smaller prefix is used for them */
+  string prefix = data.substr(0, data.find('\n', data.size() / 16) + 1);
+
+  for (size_t chunk : {1, 16, 256, 4096, 65536, 0}) {
+    const string &input = chunk < 256 ? prefix : data;
+    string name = string("chunks of ") + (chunk == 0 ? string("whole") : to_string(chunk)) + " " + label;
+
+    run_throughput(name, input.size(), [&] {
+      return parse_table(input, chunk);
+    });
+  }
+}
+
+static void bench_accessors(const string &data) {
+  csv_table *table = csv_table_create();
+  csv_table_add_data_length(table, data.data(), data.size());
+
+  vector<csv_row *> rows;
+  csv_row *row;
+  while ((row = csv_table_next_row(table)) != nullptr) {
+    rows.push_back(row);
+  }
+
+  csv_column *integer = csv_table_column(table, 0);
+  csv_column *number = csv_table_column(table, 1);
+
+  run("csv_row_value", rows.size(), [&] {
+    uint64_t sum = 0;
+    for (csv_row *row : rows) {
+      sum += csv_row_value_length(row, integer) + (csv_row_value(row, number) != nullptr);
+    }
+    sink = sum;
+  });
+
+  run("csv_row_value_int64", rows.size(), [&] {
+    uint64_t sum = 0;
+    for (csv_row *row : rows) {
+      sum += csv_row_value_int64_default(row, integer, 0);
+    }
+    sink = sum;
+  });
+
+  run("csv_row_value_int32", rows.size(), [&] {
+    uint64_t sum = 0;
+    for (csv_row *row : rows) {
+      sum += csv_row_value_int32_default(row, integer, 0);
+    }
+    sink = sum;
+  });
+
+  run("csv_row_value_double", rows.size(), [&] {
+    double sum = 0;
+    for (csv_row *row : rows) {
+      sum += csv_row_value_double_default(row, number, 0);
+    }
+    sink = static_cast<uint64_t>(sum);
+  });
+
+  run("csv_row_value_float", rows.size(), [&] {
+    float sum = 0;
+    for (csv_row *row : rows) {
+      sum += csv_row_value_float_default(row, number, 0);
+    }
+    sink = static_cast<uint64_t>(sum);
+  });
+
+  for (csv_row *row : rows) {
+    csv_row_free(row);
+  }
+  csv_table_free(table);
+}
+
+static void bench_column_lookup(const string &data) {
+  const size_t count = 1000000;
+
+  csv_table *table = csv_table_create();
+  csv_table_add_data_length(table, data.data(), data.find('\n') + 1);
+
+  vector<string> names;
+  for (size_t i = 0; i < csv_table_column_count(table); ++i) {
+    names.emplace_back(csv_column_name(csv_table_column(table, i)));
+  }
+
+  run("csv_table_column_by_name", count, [&] {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+      sum += csv_column_index(csv_table_column_by_name(table, names[i % names.size()].c_str()));
+    }
+    sink = sum;
+  });
+
+  run("csv_table_column_by_name_ignore_case", count, [&] {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < count; ++i) {
+      sum += csv_column_index(csv_table_column_by_name_ignore_case(table, names[i % names.size()].c_str()));
+    }
+    sink = sum;
+  });
+
+  csv_table_free(table);
+}
+
+
+int main() {
+  const size_t count = 1000000;
+
+  string data_path = getenv("TEST_DATA_PATH") ? getenv("TEST_DATA_PATH") : "";
+  if (data_path.empty()) {
+    data_path = __FILE__;
+    data_path = data_path.substr(0, data_path.find_last_of("/\\"));
+    data_path += "/../../test/data";
+  }
+
+  bench_integers("(1-3 digits)", generate_integers(count, 1000, true));
+  bench_integers("(8 digits)", generate_integers(count, 100000000, true));
+  bench_integers("(up to 18 digits)", generate_integers(count, UINT64_C(1000000000000000000), true));
+  bench_unsigned("(up to 20 digits)", generate_integers(count, UINT64_MAX, false));
+
+  bench_doubles("(6 digits)", generate_doubles(count, 6));
+  bench_doubles("(17 digits)", generate_doubles(count, 17));
+
+  string narrow = generate_table(3, narrow_value);
+  string wide = generate_table(100, wide_value);
+  string quoted = generate_table(6, quoted_value);
+  string numeric = generate_table(8, numeric_value);
+  string long_fields = generate_table(4, long_value);
+  string mlb_players = repeat_file(data_path + "/mlb_players.csv");
+
+  bench_table("(narrow)", narrow);
+  bench_table("(wide)", wide);
+  bench_table("(quoted)", quoted);
+  bench_table("(numeric)", numeric);
+  bench_table("(long fields)", long_fields);
+  if (!mlb_players.empty()) {
+    bench_table("(mlb_players)", mlb_players);
+    bench_chunks("(mlb_players)", mlb_players);
+  }
+  bench_chunks("(quoted)", quoted);
+
+  bench_accessors(numeric);
+  bench_column_lookup(wide);
+
+  return 0;
+}
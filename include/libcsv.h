@@ -20,6 +20,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 
 #ifndef LIBCSV_DEFAULT_SEPARATOR
@@ -30,12 +31,101 @@
 #define LIBCSV_INITIAL_TMPSTR_BUFFER 128
 #endif
 
+#ifndef LIBCSV_DEFAULT_ROW_POOL_LIMIT
+#define LIBCSV_DEFAULT_ROW_POOL_LIMIT (1024 * 1024)
+#endif
+
+#ifndef LIBCSV_PARALLEL_MIN_LENGTH
+#define LIBCSV_PARALLEL_MIN_LENGTH (1024 * 1024)
+#endif
+
+#ifndef LIBCSV_WRITER_BUFFER_SIZE
+#define LIBCSV_WRITER_BUFFER_SIZE (64 * 1024)
+#endif
+
+#ifndef LIBCSV_FOLLOW_BLOCK_SIZE
+#define LIBCSV_FOLLOW_BLOCK_SIZE (1024 * 1024)
+#endif
+
+#ifndef LIBCSV_FOLLOW_POLL_INTERVAL
+#define LIBCSV_FOLLOW_POLL_INTERVAL 100
+#endif
+
+#ifndef LIBCSV_FOLLOW_CHECK_SIZE
+#define LIBCSV_FOLLOW_CHECK_SIZE 64
+#endif
+
+#ifndef LIBCSV_DEFAULT_INDEX_INTERVAL
+#define LIBCSV_DEFAULT_INDEX_INTERVAL 4096
+#endif
+
+#ifndef LIBCSV_DEFAULT_ARENA_BLOCK_SIZE
+#define LIBCSV_DEFAULT_ARENA_BLOCK_SIZE (1024 * 1024)
+#endif
+
 
 typedef struct csv_table csv_table;
 typedef struct csv_column csv_column;
 typedef struct csv_row csv_row;
+typedef struct csv_batch csv_batch;
+typedef struct csv_channel csv_channel;
+typedef struct csv_writer csv_writer;
+typedef struct csv_arena csv_arena;
+typedef struct csv_follower csv_follower;
+
+/* Type of column values, see csv_table_set_column_type */
+typedef enum csv_type {
+  CSV_TYPE_STRING,
+  CSV_TYPE_INT8,
+  CSV_TYPE_UINT8,
+  CSV_TYPE_INT16,
+  CSV_TYPE_UINT16,
+  CSV_TYPE_INT32,
+  CSV_TYPE_UINT32,
+  CSV_TYPE_INT64,
+  CSV_TYPE_UINT64,
+  CSV_TYPE_FLOAT,
+  CSV_TYPE_DOUBLE,
+  CSV_TYPE_BOOL,
+} csv_type;
+
+/* Format of data, the default one is {LIBCSV_DEFAULT_SEPARATOR, '"', true, true} */
+typedef struct csv_dialect {
+  char separator;
+  char quote;
+  bool trim; /* spaces and tabs around values (except of escaped ones) are skipped */
+  bool cr_newline; /* '\r' ends row as well as '\n', otherwise it is a part of value */
+} csv_dialect;
+
+/* Counters of table, which are collected only if library is built with LIBCSV_STATS */
+typedef struct csv_stats {
+  uint64_t bytes_consumed;
+  uint64_t rows_emitted;
+  uint64_t fields_emitted;
+  uint64_t quoted_fields;
+  uint64_t buffer_regrowths; /* of the buffer of values of the current row */
+  uint64_t queue_resizes;
+  uint64_t queue_peak; /* the most rows queued at once */
+  uint64_t bytes_allocated; /* by rows, buffer of values, queue, chunks and data of batches */
+  uint64_t conversion_failures; /* values of typed columns, which do not match type */
+} csv_stats;
+
+/*
+ * Memory functions of table, which are called with its context, as malloc, realloc (ptr may be NULL) and free (ptr is
+ * never NULL). They must be thread-safe if table is parsed by several threads or rows are passed through channel.
+ */
+typedef struct csv_allocator {
+  void *(*alloc)(size_t size, void *context);
+  void *(*realloc)(void *ptr, size_t size, void *context);
+  void (*free)(void *ptr, void *context);
+  void *context;
+} csv_allocator;
 
 typedef void (*csv_error_callback)(const char *error, size_t line, size_t column, void *data);
+typedef void (*csv_release_callback)(const char *data, size_t length, void *release_data);
+typedef void (*csv_row_callback)(const csv_row *row, void *data);
+/* Returns false if data can not be written */
+typedef bool (*csv_write_callback)(const char *data, size_t length, void *write_data);
 
 
 #ifdef __cplusplus
@@ -45,30 +135,177 @@ extern "C" {
 
 /* Table */
 csv_table *csv_table_create();
+/* All memory of table, its rows, batches and channel is allocated by allocator (copied), NULL is malloc/realloc/free */
+csv_table *csv_table_create_with_allocator(const csv_allocator *allocator);
 void csv_table_free(csv_table *table);
 
 void csv_table_set_error_callback(csv_table *table, csv_error_callback error_callback, void *data);
+/*
+ * If row callback is set, parsed rows are passed to it instead of being queued. Row is valid only during the call and
+ * its memory is reused for the next one. NULL restores the queue. Not used in batch mode.
+ */
+void csv_table_set_row_callback(csv_table *table, csv_row_callback row_callback, void *data);
+
+/* Maximum amount of memory (in bytes) kept by freed rows for reuse */
+size_t csv_table_get_row_pool_limit(const csv_table *table);
+void csv_table_set_row_pool_limit(csv_table *table, size_t limit);
 
 char csv_table_get_separator(const csv_table *table);
 void csv_table_set_separator(csv_table *table, char separator);
 
+/* Returns false if separator and quote are the same or one of them ends rows */
+csv_dialect csv_table_get_dialect(const csv_table *table);
+bool csv_table_set_dialect(csv_table *table, csv_dialect dialect);
+
+/*
+ * Number of threads used to parse data, which is split into ranges at newlines. Rows and errors are reported in the
+ * same order as with a single thread. Data shorter than LIBCSV_PARALLEL_MIN_LENGTH per thread is parsed with fewer.
+ */
+size_t csv_table_get_thread_count(const csv_table *table);
+void csv_table_set_thread_count(csv_table *table, size_t count);
+
+/* Number of queued rows, at which csv_table_feed stops (0 if not limited). Other functions add all rows anyway */
+size_t csv_table_get_max_queued_rows(const csv_table *table);
+void csv_table_set_max_queued_rows(csv_table *table, size_t count);
+
+/*
+ * If size is not 0, rows are stored column by column in batches of up to size rows, which are returned by
+ * csv_table_next_batch instead of csv_table_next_row. Return false if a row is being parsed. Data is parsed with a
+ * single thread in this mode.
+ */
+size_t csv_table_get_batch_size(const csv_table *table);
+bool csv_table_set_batch_size(csv_table *table, size_t size);
+
 void csv_table_add_data(csv_table *table, const char *data);
 void csv_table_add_data_length(csv_table *table, const char *data, size_t length);
+/*
+ * Same, but stops once the queue has max queued rows. Returns number of consumed characters, the rest should be fed
+ * again after rows are taken. Data is parsed with a single thread.
+ */
+size_t csv_table_feed(csv_table *table, const char *data, size_t length);
+/*
+ * Zero-copy variant: values are referenced inside of data instead of being copied, and release is called once no row
+ * references data anymore. Such values are not NUL-terminated, use csv_row_value_length to get their length.
+ */
+void csv_table_add_data_retained(
+  csv_table *table,
+  const char *data,
+  size_t length,
+  csv_release_callback release,
+  void *release_data
+);
+
+/*
+ * If interval is not 0, byte offset and line of every interval-th row are recorded while parsing, so
+ * csv_table_seek_row does not parse the data from the beginning. Return false once data is added. Data is parsed with a
+ * single thread in this mode.
+ */
+size_t csv_table_get_index_interval(const csv_table *table);
+bool csv_table_set_index_interval(csv_table *table, size_t interval);
+/* Number of recorded rows, the first one is the row after header */
+size_t csv_table_index_size(const csv_table *table);
+/* Number of rows, once the latest retained data is parsed with index or its index is loaded */
+size_t csv_table_index_rows(const csv_table *table);
+/*
+ * Drops queued rows and the row being parsed, then parses the latest retained data (or mapped file) again from the
+ * nearest recorded row before row n, skipping rows up to n. Parsing stops once the queue has max queued rows, and
+ * csv_table_resume continues it. Return false if there is no index, retained data or batch mode, or the data does not
+ * contain the recorded row.
+ */
+bool csv_table_seek_row(csv_table *table, size_t n);
+/* Returns number of parsed characters, 0 if retained data ends or the queue is full */
+size_t csv_table_resume(csv_table *table);
+
+/* Feed table with contents of file, which is memory-mapped. Return false if file can not be read (errno is set) */
+bool csv_table_open_file(csv_table *table, const char *path);
+/* Same, but values reference the mapping, as with csv_table_add_data_retained */
+bool csv_table_map_file(csv_table *table, const char *path);
+/*
+ * Maps file with index (of LIBCSV_DEFAULT_INDEX_INTERVAL, if interval is not set), which is loaded from sidecar file at
+ * index_path, if it matches size and modification time of the file and dialect of table. Otherwise rows are counted
+ * and the sidecar is written. Rows are parsed only by csv_table_resume and csv_table_seek_row then. Return false if
+ * data is already added or table is in batch mode.
+ */
+bool csv_table_map_file_indexed(csv_table *table, const char *path, const char *index_path);
 
 size_t csv_table_column_count(const csv_table *table);
 csv_column *csv_table_column(const csv_table *table, size_t index);
 csv_column *csv_table_column_by_name(const csv_table *table, const char *name);
+csv_column *csv_table_column_by_name_ignore_case(const csv_table *table, const char *name);
+
+/*
+ * Only given columns are stored in the next rows, values of others are skipped while parsing and returned as NULL.
+ * Return false if header is not parsed yet or some column does not exist. Projection of the column, which is being
+ * parsed, is changed once it ends.
+ */
+bool csv_table_project_columns(csv_table *table, const size_t *indices, size_t count);
+bool csv_table_project_column_names(csv_table *table, const char *const *names, size_t count);
+void csv_table_project_all_columns(csv_table *table);
+
+/*
+ * Values of typed column are converted while parsing and stored natively instead of strings, so csv_row_value returns
+ * NULL for them and only the typed accessors are used. Values, which can not be converted, are reported as errors and
+ * are missing in rows. Return false if header is not parsed yet, column does not exist, a row is being parsed or any
+ * row is parsed already (values of rows are read according to the current types). Batches are not typed.
+ */
+bool csv_table_set_column_type(csv_table *table, size_t index, csv_type type);
+
+/* Returns false (and zeroes stats) if statistics are not collected */
+bool csv_table_get_stats(const csv_table *table, csv_stats *stats);
 
 bool csv_table_has_header(const csv_table *table);
 bool csv_table_has_row(const csv_table *table);
 size_t csv_table_available_rows(const csv_table *table);
 
 csv_row *csv_table_next_row(csv_table *table);
+/* Same as csv_row_free */
+void csv_table_recycle_row(csv_table *table, csv_row *row);
+
+/*
+ * Channel passes rows from the thread, which adds data, to another one without locks. Once it is created, parsed rows
+ * are pushed into it instead of the queue (unless there is row callback or batch mode), and they are not pooled. The
+ * channel is freed with table.
+ */
+csv_channel *csv_table_channel(csv_table *table);
+
+/* Returns full batch, or NULL. csv_table_flush_batch makes the batch being filled available, even if it is not full */
+csv_batch *csv_table_next_batch(csv_table *table);
+void csv_table_flush_batch(csv_table *table);
 
 
 /* Column */
 size_t csv_column_index(const csv_column *column);
 const char *csv_column_name(const csv_column *column);
+bool csv_column_projected(const csv_column *column);
+csv_type csv_column_type(const csv_column *column);
+
+
+/* Channel */
+/* Called by producer once all data is added, so csv_channel_next_row stops waiting */
+void csv_channel_close(csv_channel *channel);
+/* Returns NULL if there is no row yet */
+csv_row *csv_channel_try_next_row(csv_channel *channel);
+/* Waits for row, returns NULL once channel is closed and empty */
+csv_row *csv_channel_next_row(csv_channel *channel);
+
+
+/* Batch */
+void csv_batch_free(csv_batch *batch);
+
+/* Index of the first row */
+size_t csv_batch_index(const csv_batch *batch);
+size_t csv_batch_row_count(const csv_batch *batch);
+size_t csv_batch_column_count(const csv_batch *batch);
+
+/*
+ * Values of column are stored one after another in data (which is NULL if all of them are empty), value of row i is
+ * from offsets[i] to offsets[i + 1]. Bit i % 8 of validity[i / 8] is set if row has value of column, i.e. it is not
+ * missing or skipped by projection.
+ */
+const char *csv_batch_column_data(const csv_batch *batch, size_t column);
+const size_t *csv_batch_column_offsets(const csv_batch *batch, size_t column);
+const uint8_t *csv_batch_column_validity(const csv_batch *batch, size_t column);
+bool csv_batch_value_valid(const csv_batch *batch, size_t column, size_t row);
 
 
 /* Row */
@@ -77,6 +314,7 @@ size_t csv_row_index(const csv_row *row);
 bool csv_row_empty(const csv_row *row, const csv_column *column);
 
 const char *csv_row_value(const csv_row *row, const csv_column *column);
+size_t csv_row_value_length(const csv_row *row, const csv_column *column);
 const char *csv_row_value_default(const csv_row *row, const csv_column *column, const char *def);
 
 bool csv_row_value_int8(const csv_row *row, const csv_column *column, int8_t *result);
@@ -115,6 +353,97 @@ bool csv_row_value_bool_default(const csv_row *row, const csv_column *column, bo
 void csv_row_free(csv_row *row);
 
 
+/* Parsers */
+/*
+ * Strict conversions of data of given length (not required to be NUL-terminated): leading whitespace and sign are
+ * allowed, anything after the number fails conversion, as well as overflow.
+ */
+bool csv_parse_int64(const char *data, size_t length, int64_t *result);
+bool csv_parse_uint64(const char *data, size_t length, uint64_t *result);
+/* Locale-independent (decimal point is always '.') and correctly rounded, also accept inf, infinity and nan */
+bool csv_parse_float(const char *data, size_t length, float *result);
+bool csv_parse_double(const char *data, size_t length, double *result);
+/* Parses the same values as csv_row_value_bool */
+bool csv_parse_bool(const char *data, size_t length, bool *result);
+
+
+/* Writer */
+/* Output is buffered by LIBCSV_WRITER_BUFFER_SIZE bytes and passed to file descriptor, FILE or callback */
+csv_writer *csv_writer_create_fd(int fd);
+csv_writer *csv_writer_create_file(FILE *file);
+csv_writer *csv_writer_create_callback(csv_write_callback callback, void *data);
+/* Memory of writer is allocated by allocator (copied), NULL is malloc/realloc/free */
+csv_writer *csv_writer_create_fd_with_allocator(int fd, const csv_allocator *allocator);
+csv_writer *csv_writer_create_file_with_allocator(FILE *file, const csv_allocator *allocator);
+csv_writer *csv_writer_create_callback_with_allocator(
+  csv_write_callback callback,
+  void *data,
+  const csv_allocator *allocator
+);
+/* Flushes the rest of output, file is not closed */
+void csv_writer_free(csv_writer *writer);
+
+char csv_writer_get_separator(const csv_writer *writer);
+void csv_writer_set_separator(csv_writer *writer, char separator);
+/* Values are quoted with quote of dialect, and trimmed whitespace is kept by quotes only if dialect trims it */
+csv_dialect csv_writer_get_dialect(const csv_writer *writer);
+bool csv_writer_set_dialect(csv_writer *writer, csv_dialect dialect);
+
+/* Returns false if any write has failed, the output is dropped since then */
+bool csv_writer_flush(csv_writer *writer);
+
+/* Values are quoted only if they would not be parsed back as is (NULL is empty value) */
+void csv_writer_write_value(csv_writer *writer, const char *value);
+void csv_writer_write_value_length(csv_writer *writer, const char *value, size_t length);
+void csv_writer_write_int64(csv_writer *writer, int64_t value);
+void csv_writer_write_uint64(csv_writer *writer, uint64_t value);
+/* Shortest (in most cases) representation, which csv_parse_float/csv_parse_double convert back to the same value */
+void csv_writer_write_float(csv_writer *writer, float value);
+void csv_writer_write_double(csv_writer *writer, double value);
+void csv_writer_write_bool(csv_writer *writer, bool value);
+void csv_writer_end_row(csv_writer *writer);
+
+/* Write names of columns of table or values of row (typed columns are formatted, missing values are empty) */
+void csv_writer_write_header(csv_writer *writer, const csv_table *table);
+void csv_writer_write_row(csv_writer *writer, const csv_row *row);
+
+
+/* Arena */
+/*
+ * Bump allocator: memory is taken from blocks of block_size bytes (0 is LIBCSV_DEFAULT_ARENA_BLOCK_SIZE), free does
+ * nothing, and csv_arena_reset releases everything at once while the blocks are kept for reuse. Table, which uses the
+ * arena, must be freed before reset.
+ */
+csv_arena *csv_arena_create(size_t block_size);
+void csv_arena_free(csv_arena *arena);
+void csv_arena_reset(csv_arena *arena);
+
+csv_allocator csv_arena_allocator(csv_arena *arena);
+/* Bytes taken by allocations since the last reset, and bytes of blocks */
+size_t csv_arena_used(const csv_arena *arena);
+size_t csv_arena_capacity(const csv_arena *arena);
+
+
+/* Follow */
+/*
+ * Follower feeds table with data, which is appended to file, reading it by LIBCSV_FOLLOW_BLOCK_SIZE bytes. Changes
+ * are watched with inotify on Linux, elsewhere file is checked every LIBCSV_FOLLOW_POLL_INTERVAL milliseconds. Once
+ * file is truncated or replaced (after the old one is read up to its end), the row being parsed is dropped, and the
+ * file is read from the beginning, skipping its first line (header). File is also considered truncated if the last
+ * LIBCSV_FOLLOW_CHECK_SIZE read bytes are changed, so it may be rewritten in place. Follower must be freed before
+ * table. Returns NULL if file can not be opened or following is not supported (errno is set).
+ */
+csv_follower *csv_follower_create(csv_table *table, const char *path);
+void csv_follower_free(csv_follower *follower);
+/*
+ * Reads new data, waiting for it up to timeout milliseconds (negative waits forever). Returns number of read bytes, 0
+ * if there is no data in time or the follower is stopped.
+ */
+size_t csv_follower_poll(csv_follower *follower, int timeout);
+/* Wakes up csv_follower_poll (from another thread), it returns 0 since then */
+void csv_follower_stop(csv_follower *follower);
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -22,8 +22,19 @@
 #include "libcsv.h"
 
 #include <deque>
+#include <functional>
+#include <iterator>
 #include <string>
 #include <memory>
+#include <vector>
+
+#if __cplusplus >= 201703L
+#include <string_view>
+#endif
+
+#if __cplusplus >= 202002L
+#include <ranges>
+#endif
 
 namespace libcsv {
 struct CSVError {
@@ -60,6 +71,14 @@ public:
     return csv_column_name(column);
   }
 
+  inline bool isProjected() const {
+    return csv_column_projected(column);
+  }
+
+  inline csv_type getType() const {
+    return csv_column_type(column);
+  }
+
   operator bool() const {
     return column != nullptr;
   }
@@ -68,144 +87,524 @@ public:
 class CSVRow {
   friend class CSVColumn;
   friend class CSVTable;
+  friend class CSVChannel;
+  friend class CSVWriter;
+  friend class CSVRowRange;
 
 private:
-  std::shared_ptr<csv_row> row;
+  csv_row *row;
+  bool owned; /* row is freed by CSVRow, borrowed ones belong to table */
 
 public:
-  inline CSVRow() : row {nullptr, csv_row_free} {}
+  inline CSVRow() : row {nullptr}, owned {false} {}
 
 private:
-  inline CSVRow(csv_row *row) : row {row, csv_row_free} {}
+  inline CSVRow(csv_row *row) : row {row}, owned {true} {}
+
+  /* Row, which is not freed by CSVRow */
+  inline static CSVRow borrow(const csv_row *row) {
+    CSVRow result;
+    result.row = const_cast<csv_row *>(row);
+    return result;
+  }
+
+  inline void reset() {
+    if (owned) {
+      csv_row_free(row);
+    }
+
+    row = nullptr;
+    owned = false;
+  }
 
 public:
-  inline CSVRow(const CSVRow &row) = default;
+  /* Rows are only moved, so they are owned without reference counting */
+  inline CSVRow(const CSVRow &) = delete;
+  inline CSVRow &operator=(const CSVRow &) = delete;
+
+  inline CSVRow(CSVRow &&other) noexcept : row {other.row}, owned {other.owned} {
+    other.row = nullptr;
+    other.owned = false;
+  }
+
+  inline CSVRow &operator=(CSVRow &&other) noexcept {
+    if (this != &other) {
+      reset();
+      row = other.row;
+      owned = other.owned;
+      other.row = nullptr;
+      other.owned = false;
+    }
+
+    return *this;
+  }
+
+  inline ~CSVRow() {
+    reset();
+  }
 
 
   inline size_t getIndex() const {
-    return csv_row_index(row.get());
+    return csv_row_index(row);
   }
 
   inline bool isEmpty(const CSVColumn column) const {
-    return csv_row_empty(row.get(), column.column);
+    return csv_row_empty(row, column.column);
   }
 
   inline std::string getValue(const CSVColumn column) const {
-    return {csv_row_value(row.get(), column.column)};
+    const char *value = csv_row_value(row, column.column);
+    if (value == nullptr) {
+      return {};
+    }
+
+    return {value, csv_row_value_length(row, column.column)};
+  }
+
+#if __cplusplus >= 201703L
+  /* Value without copy, valid while the row is */
+  inline std::string_view getView(const CSVColumn column) const {
+    const char *value = csv_row_value(row, column.column);
+    if (value == nullptr) {
+      return {};
+    }
+
+    return {value, csv_row_value_length(row, column.column)};
   }
+#endif
 
 
   inline bool getValue(const CSVColumn column, int8_t &result) const {
-    return csv_row_value_int8(row.get(), column.column, &result);
+    return csv_row_value_int8(row, column.column, &result);
   }
 
   inline int8_t getValueOr(const CSVColumn column, int8_t def) const {
-    return csv_row_value_int8_default(row.get(), column.column, def);
+    return csv_row_value_int8_default(row, column.column, def);
   }
 
 
   inline bool getValue(const CSVColumn column, uint8_t &result) const {
-    return csv_row_value_uint8(row.get(), column.column, &result);
+    return csv_row_value_uint8(row, column.column, &result);
   }
 
   inline uint8_t getValueOr(const CSVColumn column, uint8_t def) const {
-    return csv_row_value_uint8_default(row.get(), column.column, def);
+    return csv_row_value_uint8_default(row, column.column, def);
   }
 
 
   inline bool getValue(const CSVColumn column, int16_t &result) const {
-    return csv_row_value_int16(row.get(), column.column, &result);
+    return csv_row_value_int16(row, column.column, &result);
   }
 
   inline int16_t getValueOr(const CSVColumn column, int16_t def) const {
-    return csv_row_value_int16_default(row.get(), column.column, def);
+    return csv_row_value_int16_default(row, column.column, def);
   }
 
 
   inline bool getValue(const CSVColumn column, uint16_t &result) const {
-    return csv_row_value_uint16(row.get(), column.column, &result);
+    return csv_row_value_uint16(row, column.column, &result);
   }
 
   inline uint16_t getValueOr(const CSVColumn column, uint16_t def) const {
-    return csv_row_value_uint16_default(row.get(), column.column, def);
+    return csv_row_value_uint16_default(row, column.column, def);
   }
 
 
   inline bool getValue(const CSVColumn column, int32_t &result) const {
-    return csv_row_value_int32(row.get(), column.column, &result);
+    return csv_row_value_int32(row, column.column, &result);
   }
 
   inline int32_t getValueOr(const CSVColumn column, int32_t def) const {
-    return csv_row_value_int32_default(row.get(), column.column, def);
+    return csv_row_value_int32_default(row, column.column, def);
   }
 
 
   inline bool getValue(const CSVColumn column, uint32_t &result) const {
-    return csv_row_value_uint32(row.get(), column.column, &result);
+    return csv_row_value_uint32(row, column.column, &result);
   }
 
   inline uint32_t getValueOr(const CSVColumn column, uint32_t def) const {
-    return csv_row_value_uint32_default(row.get(), column.column, def);
+    return csv_row_value_uint32_default(row, column.column, def);
   }
 
 
   inline bool getValue(const CSVColumn column, int64_t &result) const {
-    return csv_row_value_int64(row.get(), column.column, &result);
+    return csv_row_value_int64(row, column.column, &result);
   }
 
   inline int64_t getValueOr(const CSVColumn column, int64_t def) const {
-    return csv_row_value_int64_default(row.get(), column.column, def);
+    return csv_row_value_int64_default(row, column.column, def);
   }
 
 
   inline bool getValue(const CSVColumn column, uint64_t &result) const {
-    return csv_row_value_uint64(row.get(), column.column, &result);
+    return csv_row_value_uint64(row, column.column, &result);
   }
 
   inline uint64_t getValueOr(const CSVColumn column, uint64_t def) const {
-    return csv_row_value_uint64_default(row.get(), column.column, def);
+    return csv_row_value_uint64_default(row, column.column, def);
   }
 
 
   inline bool getValue(const CSVColumn column, float &result) const {
-    return csv_row_value_float(row.get(), column.column, &result);
+    return csv_row_value_float(row, column.column, &result);
   }
 
   inline float getValueOr(const CSVColumn column, float def) const {
-    return csv_row_value_float_default(row.get(), column.column, def);
+    return csv_row_value_float_default(row, column.column, def);
   }
 
   
   inline bool getValue(const CSVColumn column, double &result) const {
-    return csv_row_value_double(row.get(), column.column, &result);
+    return csv_row_value_double(row, column.column, &result);
   }
 
   inline double getValueOr(const CSVColumn column, double def) const {
-    return csv_row_value_double_default(row.get(), column.column, def);
+    return csv_row_value_double_default(row, column.column, def);
   }
 
 
   inline bool getValueBool(const CSVColumn column) const {
-    return csv_row_value_bool(row.get(), column.column);
+    return csv_row_value_bool(row, column.column);
   }
 
   inline bool getValueOr(const CSVColumn column, bool def) const {
-    return csv_row_value_bool_default(row.get(), column.column, def);
+    return csv_row_value_bool_default(row, column.column, def);
+  }
+
+
+  operator bool() const {
+    return row != nullptr;
+  }
+};
+
+#if __cplusplus >= 201703L
+/* Values of a column in batch, as a sequence of std::string_view */
+class CSVBatchColumn {
+  friend class CSVBatch;
+
+private:
+  const char *data;
+  const size_t *offsets;
+  const uint8_t *validity;
+  size_t count;
+
+  inline CSVBatchColumn(const csv_batch *batch, size_t column) :
+    data {csv_batch_column_data(batch, column)},
+    offsets {csv_batch_column_offsets(batch, column)},
+    validity {csv_batch_column_validity(batch, column)},
+    count {csv_batch_row_count(batch)} {}
+
+public:
+  class iterator {
+    friend class CSVBatchColumn;
+
+  private:
+    const CSVBatchColumn *column;
+    size_t row;
+
+    inline iterator(const CSVBatchColumn *column, size_t row) : column {column}, row {row} {}
+
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = std::string_view;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const std::string_view *;
+    using reference = std::string_view;
+
+    inline std::string_view operator*() const {
+      return (*column)[row];
+    }
+
+    inline iterator &operator++() {
+      ++row;
+      return *this;
+    }
+
+    inline iterator operator++(int) {
+      iterator result = *this;
+      ++row;
+      return result;
+    }
+
+    inline bool operator==(const iterator &other) const {
+      return row == other.row;
+    }
+
+    inline bool operator!=(const iterator &other) const {
+      return row != other.row;
+    }
+  };
+
+  inline size_t size() const {
+    return count;
+  }
+
+  inline bool isValid(size_t row) const {
+    return (validity[row / 8] >> (row % 8)) & 1;
+  }
+
+  inline std::string_view operator[](size_t row) const {
+    return {data + offsets[row], offsets[row + 1] - offsets[row]};
+  }
+
+  inline iterator begin() const {
+    return {this, 0};
+  }
+
+  inline iterator end() const {
+    return {this, count};
+  }
+};
+
+class CSVBatch {
+  friend class CSVTable;
+
+private:
+  std::shared_ptr<csv_batch> batch;
+
+public:
+  inline CSVBatch() : batch {nullptr, csv_batch_free} {}
+
+private:
+  inline CSVBatch(csv_batch *batch) : batch {batch, csv_batch_free} {}
+
+public:
+  inline size_t getIndex() const {
+    return csv_batch_index(batch.get());
+  }
+
+  inline size_t getRowCount() const {
+    return csv_batch_row_count(batch.get());
+  }
+
+  inline size_t getColumnCount() const {
+    return csv_batch_column_count(batch.get());
+  }
+
+  inline CSVBatchColumn getColumn(size_t index) const {
+    return {batch.get(), index};
+  }
+
+  inline CSVBatchColumn getColumn(const CSVColumn column) const {
+    return {batch.get(), column.getIndex()};
   }
 
 
   operator bool() const {
-    return row.operator bool();
+    return batch.operator bool();
+  }
+};
+#endif
+
+/*
+ * Single-pass range of rows of table, see CSVTable::rows. Row is freed once iterator is incremented, so the next one
+ * reuses its memory. Data, if given, is fed by parts when the queue is empty, so parsing stops once iteration does.
+ */
+class CSVRowRange
+#if __cplusplus >= 202002L
+  : public std::ranges::view_base
+#endif
+{
+  friend class CSVTable;
+
+public:
+  static constexpr size_t feedLength = 64 * 1024;
+
+private:
+  csv_table *table;
+  const char *data;
+  size_t length;
+  CSVRow row;
+
+  inline CSVRowRange(csv_table *table, const char *data, size_t length) :
+    table {table},
+    data {data},
+    length {length},
+    row {} {}
+
+  inline void advance() {
+    /* Previous row is freed first */
+    row = CSVRow {};
+
+    for (;;) {
+      csv_row *next = csv_table_next_row(table);
+      if (next != nullptr) {
+        row = CSVRow {next};
+        return;
+      }
+
+      if (length == 0) {
+        return;
+      }
+
+      size_t consumed = csv_table_feed(table, data, length < feedLength ? length : feedLength);
+      data += consumed;
+      length -= consumed;
+    }
+  }
+
+public:
+  inline CSVRowRange() : table {nullptr}, data {nullptr}, length {0}, row {} {}
+
+  class iterator {
+    friend class CSVRowRange;
+
+  private:
+    CSVRowRange *range;
+
+    inline iterator(CSVRowRange *range) : range {range} {}
+
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = CSVRow;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const CSVRow *;
+    using reference = const CSVRow &;
+
+    inline iterator() : range {nullptr} {}
+
+    inline const CSVRow &operator*() const {
+      return range->row;
+    }
+
+    inline const CSVRow *operator->() const {
+      return &range->row;
+    }
+
+    inline iterator &operator++() {
+      range->advance();
+      return *this;
+    }
+
+    inline void operator++(int) {
+      range->advance();
+    }
+
+    /* Iterator of range without more rows is equal to end */
+    inline bool operator==(const iterator &other) const {
+      return (range == nullptr || !range->row) && (other.range == nullptr || !other.range->row);
+    }
+
+    inline bool operator!=(const iterator &other) const {
+      return !(*this == other);
+    }
+  };
+
+  inline iterator begin() {
+    advance();
+    return {this};
+  }
+
+  inline iterator end() {
+    return {};
+  }
+};
+
+class CSVChannel {
+  friend class CSVTable;
+
+private:
+  std::shared_ptr<csv_table> table; /* owns the channel */
+  csv_channel *channel;
+
+public:
+  inline CSVChannel() : table {}, channel {nullptr} {}
+
+private:
+  inline CSVChannel(std::shared_ptr<csv_table> table, csv_channel *channel) : table {table}, channel {channel} {}
+
+public:
+  inline void close() {
+    csv_channel_close(channel);
+  }
+
+  inline CSVRow tryNextRow() {
+    return csv_channel_try_next_row(channel);
+  }
+
+  inline CSVRow nextRow() {
+    return csv_channel_next_row(channel);
+  }
+
+
+  operator bool() const {
+    return channel != nullptr;
+  }
+};
+
+/* Follows file, which is appended to, see csv_follower_create */
+class CSVFollower {
+  friend class CSVTable;
+
+private:
+  std::shared_ptr<csv_table> table; /* declared first, so it outlives the follower */
+  std::shared_ptr<csv_follower> follower;
+
+public:
+  inline CSVFollower() : table {}, follower {} {}
+
+private:
+  inline CSVFollower(std::shared_ptr<csv_table> table, csv_follower *follower)
+    : table {table}, follower {follower, csv_follower_free} {}
+
+public:
+  /* Returns number of read bytes, 0 on timeout (in milliseconds, negative waits forever) or once stopped */
+  inline size_t poll(int timeout = -1) {
+    return csv_follower_poll(follower.get(), timeout);
+  }
+
+  inline void stop() {
+    csv_follower_stop(follower.get());
+  }
+
+
+  operator bool() const {
+    return follower != nullptr;
+  }
+};
+
+/* Bump allocator for tables, see csv_arena_create. Tables using it must be destroyed before reset and the arena */
+class CSVArena {
+private:
+  std::shared_ptr<csv_arena> arena;
+
+public:
+  inline explicit CSVArena(size_t blockSize = 0) : arena {csv_arena_create(blockSize), csv_arena_free} {
+    if (!arena) {
+      throw std::bad_alloc {};
+    }
+  }
+
+  inline CSVArena(const CSVArena &) = delete;
+  inline CSVArena(CSVArena &&) = default;
+
+  inline csv_allocator getAllocator() const {
+    return csv_arena_allocator(arena.get());
+  }
+
+  inline void reset() {
+    csv_arena_reset(arena.get());
+  }
+
+  inline size_t getUsed() const {
+    return csv_arena_used(arena.get());
+  }
+
+  inline size_t getCapacity() const {
+    return csv_arena_capacity(arena.get());
   }
 };
 
 class CSVTable {
   friend class CSVColumn;
   friend class CSVRow;
+  friend class CSVWriter;
 
 private:
   std::shared_ptr<csv_table> table;
   std::deque<CSVError> errors;
+  std::unique_ptr<std::function<void(const CSVRow &)>> rowCallback; /* stays at the same address if moved */
 
 public:
   inline CSVTable() : table {csv_table_create(), csv_table_free} {
@@ -215,6 +614,18 @@ public:
 
     csv_table_set_error_callback(table.get(), &CSVTable::private_error_callback, this);
   }
+
+  inline explicit CSVTable(const csv_allocator &allocator)
+    : table {csv_table_create_with_allocator(&allocator), csv_table_free} {
+    if (!table) {
+      throw std::bad_alloc {};
+    }
+
+    csv_table_set_error_callback(table.get(), &CSVTable::private_error_callback, this);
+  }
+
+  inline explicit CSVTable(const CSVArena &arena) : CSVTable(arena.getAllocator()) {}
+
   inline CSVTable(const CSVTable &) = delete;
   inline CSVTable(CSVTable &&) = default;
 
@@ -224,7 +635,25 @@ private:
     self->errors.emplace_back(error, line, column);
   }
 
+  static void private_row_callback(const csv_row *row, void *callback) {
+    (*reinterpret_cast<std::function<void(const CSVRow &)> *>(callback))(CSVRow::borrow(row));
+  }
+
 public:
+  /* Row passed to callback is valid only during the call, see csv_table_set_row_callback */
+  inline void setRowCallback(std::function<void(const CSVRow &)> callback) {
+    if (callback) {
+      std::unique_ptr<std::function<void(const CSVRow &)>> holder {
+        new std::function<void(const CSVRow &)> {std::move(callback)}
+      };
+      csv_table_set_row_callback(table.get(), &CSVTable::private_row_callback, holder.get());
+      rowCallback = std::move(holder);
+    } else {
+      csv_table_set_row_callback(table.get(), nullptr, nullptr);
+      rowCallback.reset();
+    }
+  }
+
   inline bool hasError() const {
     return !errors.empty();
   }
@@ -239,6 +668,14 @@ public:
     return false;
   }
 
+  inline size_t getRowPoolLimit() const {
+    return csv_table_get_row_pool_limit(table.get());
+  }
+
+  inline void setRowPoolLimit(size_t limit) {
+    csv_table_set_row_pool_limit(table.get(), limit);
+  }
+
   inline char getSeparator() const {
     return csv_table_get_separator(table.get());
   }
@@ -247,6 +684,22 @@ public:
     csv_table_set_separator(table.get(), c);
   }
 
+  inline csv_dialect getDialect() const {
+    return csv_table_get_dialect(table.get());
+  }
+
+  inline bool setDialect(const csv_dialect &dialect) {
+    return csv_table_set_dialect(table.get(), dialect);
+  }
+
+  inline size_t getThreadCount() const {
+    return csv_table_get_thread_count(table.get());
+  }
+
+  inline void setThreadCount(size_t count) {
+    csv_table_set_thread_count(table.get(), count);
+  }
+
 
   inline void addData(const char *data) {
     csv_table_add_data(table.get(), data);
@@ -260,6 +713,81 @@ public:
     csv_table_add_data_length(table.get(), data.c_str(), data.length());
   }
 
+  inline size_t feed(const char *data, size_t length) {
+    return csv_table_feed(table.get(), data, length);
+  }
+
+  inline size_t feed(const std::string &data) {
+    return csv_table_feed(table.get(), data.data(), data.length());
+  }
+
+  /* Queued rows, then rows of data, which must outlive the range */
+  inline CSVRowRange rows() {
+    return {table.get(), nullptr, 0};
+  }
+
+  inline CSVRowRange rows(const char *data, size_t length) {
+    return {table.get(), data, length};
+  }
+
+  inline CSVRowRange rows(const std::string &data) {
+    return {table.get(), data.data(), data.length()};
+  }
+
+  CSVRowRange rows(std::string &&data) = delete;
+
+  inline bool openFile(const char *path) {
+    return csv_table_open_file(table.get(), path);
+  }
+
+  inline bool openFile(const std::string &path) {
+    return csv_table_open_file(table.get(), path.c_str());
+  }
+
+  inline bool mapFile(const char *path) {
+    return csv_table_map_file(table.get(), path);
+  }
+
+  inline bool mapFile(const std::string &path) {
+    return csv_table_map_file(table.get(), path.c_str());
+  }
+
+  inline bool mapFileIndexed(const char *path, const char *indexPath) {
+    return csv_table_map_file_indexed(table.get(), path, indexPath);
+  }
+
+  inline bool mapFileIndexed(const std::string &path, const std::string &indexPath) {
+    return csv_table_map_file_indexed(table.get(), path.c_str(), indexPath.c_str());
+  }
+
+  inline void addDataRetained(const char *data, size_t length, csv_release_callback release, void *release_data) {
+    csv_table_add_data_retained(table.get(), data, length, release, release_data);
+  }
+
+  inline size_t getIndexInterval() const {
+    return csv_table_get_index_interval(table.get());
+  }
+
+  inline bool setIndexInterval(size_t interval) {
+    return csv_table_set_index_interval(table.get(), interval);
+  }
+
+  inline size_t getIndexSize() const {
+    return csv_table_index_size(table.get());
+  }
+
+  inline size_t getIndexRows() const {
+    return csv_table_index_rows(table.get());
+  }
+
+  inline bool seekRow(size_t n) {
+    return csv_table_seek_row(table.get(), n);
+  }
+
+  inline size_t resume() {
+    return csv_table_resume(table.get());
+  }
+
 
   inline size_t getColumnCount() const {
     return csv_table_column_count(table.get());
@@ -277,11 +805,45 @@ public:
     return csv_table_column_by_name(table.get(), name.c_str());
   }
 
+  inline CSVColumn getColumnIgnoreCase(const char *name) const {
+    return csv_table_column_by_name_ignore_case(table.get(), name);
+  }
+
+  inline CSVColumn getColumnIgnoreCase(const std::string &name) const {
+    return csv_table_column_by_name_ignore_case(table.get(), name.c_str());
+  }
+
+  inline bool projectColumns(const std::vector<size_t> &indices) {
+    return csv_table_project_columns(table.get(), indices.data(), indices.size());
+  }
+
+  inline bool projectColumnNames(const std::vector<std::string> &names) {
+    std::vector<const char *> c_names;
+    c_names.reserve(names.size());
+    for (const std::string &name : names) {
+      c_names.push_back(name.c_str());
+    }
+
+    return csv_table_project_column_names(table.get(), c_names.data(), c_names.size());
+  }
+
+  inline void projectAllColumns() {
+    csv_table_project_all_columns(table.get());
+  }
+
+  inline bool setColumnType(const CSVColumn column, csv_type type) {
+    return csv_table_set_column_type(table.get(), column.getIndex(), type);
+  }
+
 
   inline bool hasHeader() const {
     return csv_table_has_header(table.get());
   }
 
+  inline bool getStats(csv_stats &stats) const {
+    return csv_table_get_stats(table.get(), &stats);
+  }
+
   inline bool hasRow() const {
     return csv_table_has_row(table.get());
   }
@@ -294,6 +856,229 @@ public:
   inline CSVRow nextRow() {
     return csv_table_next_row(table.get());
   }
+
+
+  inline size_t getMaxQueuedRows() const {
+    return csv_table_get_max_queued_rows(table.get());
+  }
+
+  inline void setMaxQueuedRows(size_t count) {
+    csv_table_set_max_queued_rows(table.get(), count);
+  }
+
+  inline size_t getBatchSize() const {
+    return csv_table_get_batch_size(table.get());
+  }
+
+  inline bool setBatchSize(size_t size) {
+    return csv_table_set_batch_size(table.get(), size);
+  }
+
+  inline void flushBatch() {
+    csv_table_flush_batch(table.get());
+  }
+
+#if __cplusplus >= 201703L
+  inline CSVBatch nextBatch() {
+    return csv_table_next_batch(table.get());
+  }
+#endif
+
+
+  inline CSVChannel getChannel() {
+    return {table, csv_table_channel(table.get())};
+  }
+
+  /* Returns empty follower if file can not be followed */
+  inline CSVFollower follow(const char *path) {
+    csv_follower *follower = csv_follower_create(table.get(), path);
+    if (follower == nullptr) {
+      return {};
+    }
+
+    return {table, follower};
+  }
+
+  inline CSVFollower follow(const std::string &path) {
+    return follow(path.c_str());
+  }
+};
+
+/* Dialect, which is known at compile time, see csv_dialect */
+template<char Separator, char Quote = '"', bool Trim = true, bool CRNewline = true>
+struct Dialect {
+  static constexpr char separator = Separator;
+  static constexpr char quote = Quote;
+  static constexpr bool trim = Trim;
+  static constexpr bool crNewline = CRNewline;
+
+  static_assert(separator != quote, "Separator and quote must differ");
+  static_assert(separator != '\n' && quote != '\n', "Newline can not be separator or quote");
+  static_assert(!crNewline || (separator != '\r' && quote != '\r'), "Carriage return ends rows in this dialect");
+};
+
+using CSVDialect = Dialect<','>;
+/* Tab-separated values, tabs and spaces are a part of values */
+using TSVDialect = Dialect<'\t', '"', false>;
+
+/* Table, which parses data in the fixed dialect D */
+template<typename D>
+class BasicParser : public CSVTable {
+public:
+  using dialect_type = D;
+
+  inline BasicParser() : CSVTable {} {
+    CSVTable::setDialect({D::separator, D::quote, D::trim, D::crNewline});
+  }
+
+  inline BasicParser(const BasicParser &) = delete;
+  inline BasicParser(BasicParser &&) = default;
+
+  void setSeparator(char c) = delete;
+  bool setDialect(const csv_dialect &dialect) = delete;
+};
+
+using CSVParser = BasicParser<CSVDialect>;
+using TSVParser = BasicParser<TSVDialect>;
+
+class CSVWriter {
+private:
+  std::shared_ptr<csv_writer> writer;
+  std::unique_ptr<std::function<bool(const char *, size_t)>> callback; /* stays at the same address if moved */
+
+public:
+  inline CSVWriter(int fd) : writer {csv_writer_create_fd(fd), csv_writer_free} {
+    if (!writer) {
+      throw std::bad_alloc {};
+    }
+  }
+
+  inline CSVWriter(FILE *file) : writer {csv_writer_create_file(file), csv_writer_free} {
+    if (!writer) {
+      throw std::bad_alloc {};
+    }
+  }
+
+  inline CSVWriter(std::function<bool(const char *, size_t)> callback)
+    : callback {new std::function<bool(const char *, size_t)> {std::move(callback)}} {
+    writer = {csv_writer_create_callback(&CSVWriter::private_write_callback, this->callback.get()), csv_writer_free};
+    if (!writer) {
+      throw std::bad_alloc {};
+    }
+  }
+
+  inline CSVWriter(int fd, const csv_allocator &allocator)
+    : writer {csv_writer_create_fd_with_allocator(fd, &allocator), csv_writer_free} {
+    if (!writer) {
+      throw std::bad_alloc {};
+    }
+  }
+
+  inline CSVWriter(FILE *file, const csv_allocator &allocator)
+    : writer {csv_writer_create_file_with_allocator(file, &allocator), csv_writer_free} {
+    if (!writer) {
+      throw std::bad_alloc {};
+    }
+  }
+
+  inline CSVWriter(std::function<bool(const char *, size_t)> callback, const csv_allocator &allocator)
+    : callback {new std::function<bool(const char *, size_t)> {std::move(callback)}} {
+    writer = {
+      csv_writer_create_callback_with_allocator(&CSVWriter::private_write_callback, this->callback.get(), &allocator),
+      csv_writer_free
+    };
+    if (!writer) {
+      throw std::bad_alloc {};
+    }
+  }
+
+  inline CSVWriter(const CSVWriter &) = delete;
+  inline CSVWriter(CSVWriter &&) = default;
+
+  inline ~CSVWriter() {
+    /* Output is flushed before callback is destroyed */
+    writer.reset();
+  }
+
+private:
+  static bool private_write_callback(const char *data, size_t length, void *callback) {
+    return (*reinterpret_cast<std::function<bool(const char *, size_t)> *>(callback))(data, length);
+  }
+
+public:
+  inline char getSeparator() const {
+    return csv_writer_get_separator(writer.get());
+  }
+
+  inline void setSeparator(char c) {
+    csv_writer_set_separator(writer.get(), c);
+  }
+
+  inline csv_dialect getDialect() const {
+    return csv_writer_get_dialect(writer.get());
+  }
+
+  inline bool setDialect(const csv_dialect &dialect) {
+    return csv_writer_set_dialect(writer.get(), dialect);
+  }
+
+  inline bool flush() {
+    return csv_writer_flush(writer.get());
+  }
+
+
+  inline void write(const char *value) {
+    csv_writer_write_value(writer.get(), value);
+  }
+
+  inline void write(const char *value, size_t length) {
+    csv_writer_write_value_length(writer.get(), value, length);
+  }
+
+  inline void write(const std::string &value) {
+    csv_writer_write_value_length(writer.get(), value.data(), value.size());
+  }
+
+  inline void write(int32_t value) {
+    csv_writer_write_int64(writer.get(), value);
+  }
+
+  inline void write(uint32_t value) {
+    csv_writer_write_uint64(writer.get(), value);
+  }
+
+  inline void write(int64_t value) {
+    csv_writer_write_int64(writer.get(), value);
+  }
+
+  inline void write(uint64_t value) {
+    csv_writer_write_uint64(writer.get(), value);
+  }
+
+  inline void write(float value) {
+    csv_writer_write_float(writer.get(), value);
+  }
+
+  inline void write(double value) {
+    csv_writer_write_double(writer.get(), value);
+  }
+
+  inline void write(bool value) {
+    csv_writer_write_bool(writer.get(), value);
+  }
+
+  inline void endRow() {
+    csv_writer_end_row(writer.get());
+  }
+
+
+  inline void writeHeader(const CSVTable &table) {
+    csv_writer_write_header(writer.get(), table.table.get());
+  }
+
+  inline void writeRow(const CSVRow &row) {
+    csv_writer_write_row(writer.get(), row.row);
+  }
 };
 }
 
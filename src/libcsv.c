@@ -15,13 +15,83 @@
  */
 
 #include "libcsv.h"
+#include "libcsv_pow5.h"
 
 #include <assert.h>
+#include <errno.h>
+#include <float.h>
+#include <locale.h>
+#include <math.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <inttypes.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+#define LIBCSV_HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LIBCSV_HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LIBCSV_HAVE_FOLLOW
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#endif
+
+#if defined(__linux__) && !defined(LIBCSV_DISABLE_INOTIFY)
+#define LIBCSV_HAVE_INOTIFY
+#include <sys/inotify.h>
+#endif
+
+#if !defined(LIBCSV_DISABLE_SIMD) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LIBCSV_SIMD_X86
+#include <immintrin.h>
+#endif
+
+/* Counters of csv_stats, which are not compiled at all without LIBCSV_STATS */
+#ifdef LIBCSV_STATS
+#define LIBCSV_STAT_ADD(table, counter, value) ((table)->stats.counter += (value))
+#define LIBCSV_STAT_MAX(table, counter, value) do { \
+    uint64_t stat_value = (value); \
+    if ((table)->stats.counter < stat_value) { \
+      (table)->stats.counter = stat_value; \
+    } \
+  } while (0)
+#else
+#define LIBCSV_STAT_ADD(table, counter, value) ((void) 0)
+#define LIBCSV_STAT_MAX(table, counter, value) ((void) 0)
+#endif
+
+#ifdef __GNUC__
+#define LIBCSV_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define LIBCSV_ALWAYS_INLINE inline
+#endif
+
+/* Size of buffer for numeric values which are not NUL-terminated */
+#define LIBCSV_NUMBER_BUFFER 128
+
+#define LIBCSV_ROW_ALIGNMENT 64
+
+#define LIBCSV_CACHE_LINE 64
+
+/* Capacity of the first segment of channel, next ones are twice as large up to the maximum */
+#define LIBCSV_CHANNEL_SEGMENT_MIN 64
+#define LIBCSV_CHANNEL_SEGMENT_MAX 4096
+
+/* Number of attempts to take row before consumer sleeps */
+#define LIBCSV_CHANNEL_SPIN 128
+
 
 static char convert_to_lower(char c) {
   if (c >= 'A' && c <= 'Z') {
@@ -44,618 +114,4572 @@ static bool equals_ignore_case(const char *a, const char *b) {
   return *a == *b;
 }
 
+/* FNV-1a of lower case string, so it is suitable for both exact and case insensitive comparison */
+static size_t hash_ignore_case(const char *str) {
+  uint64_t hash = UINT64_C(14695981039346656037);
 
-enum csv_table_state {
-  TABLE_STATE_NEWLINE,
+  for (; *str; ++str) {
+    hash ^= (unsigned char) convert_to_lower(*str);
+    hash *= UINT64_C(1099511628211);
+  }
 
-  TABLE_STATE_COLUMN_BEGIN,
-  TABLE_STATE_COLUMN_IN,
-  TABLE_STATE_COLUMN_IN_ESCAPE,
-  TABLE_STATE_COLUMN_IN_ESCAPE_ESCAPE,
-  TABLE_STATE_COLUMN_IN_ESCAPE_END,
-};
+  return (size_t) hash;
+}
 
-struct csv_table {
-  csv_error_callback error_callback;
-  void *error_callback_data;
+static unsigned count_leading_zeros(uint64_t value) {
+#if defined(__GNUC__)
+  return __builtin_clzll(value);
+#else
+  unsigned count = 0;
+  for (; (value & (UINT64_C(1) << 63)) == 0; value <<= 1) {
+    ++count;
+  }
+  return count;
+#endif
+}
 
-  char separator;
+static unsigned count_trailing_zeros(uint64_t value) {
+#if defined(__GNUC__)
+  return __builtin_ctzll(value);
+#else
+  unsigned count = 0;
+  for (; (value & 1) == 0; value >>= 1) {
+    ++count;
+  }
+  return count;
+#endif
+}
 
-  enum csv_table_state state;
-  size_t state_line, state_column;
-  char *state_cs;
-  size_t state_cs_len, state_cs_cap;
-  csv_row *state_row;
-  size_t state_row_column;
 
-  bool has_header;
+/* Scanner */
 
-  size_t columns_count;
-  csv_column *columns;
+/*
+ * The scanner classifies input by blocks of LIBCSV_SCAN_BLOCK bytes. For every block two bitmasks are built:
+ * - plain: separator, '\n' and '\r' (characters which end an unescaped column);
+ * - escaped: quote and '\n' (characters which are interesting inside of escaped column).
+ * Runs of ordinary characters between structural ones are then copied without going through the state machine.
+ */
+#define LIBCSV_SCAN_BLOCK 64
 
-  size_t rows_counter;
-  size_t rows_begin;
-  size_t rows_end;
-  size_t rows_capacity; /* = 2^rows_capacity_log */
-  size_t rows_capacity_log; /* = log2 rows_capacity */
-  size_t rows_capacity_mask; /* = (~0) >> (sizeof(rows_capacity_mask) * 8 - rows_capacity_log) */
-  csv_row **rows_queue;
-};
+typedef void (*csv_scan_block_function)(
+  const char *block, char separator, char quote, uint64_t *plain, uint64_t *escaped
+);
 
-struct csv_column {
-  csv_table *table;
-  size_t index;
-  char *name;
-};
+struct csv_scanner {
+  csv_scan_block_function scan_block;
+  char separator;
+  char quote;
 
-struct csv_row {
-  csv_table *table;
-  size_t index;
-  char *values[0];
+  const char *base;
+  uint64_t plain, escaped;
 };
 
+static void csv_scan_block_scalar(const char *block, char separator, char quote, uint64_t *plain, uint64_t *escaped) {
+  uint64_t p = 0, e = 0;
 
-/* Table */
-csv_table *csv_table_create() {
-  csv_table *table = malloc(sizeof(csv_table));
+  for (unsigned i = 0; i < LIBCSV_SCAN_BLOCK; ++i) {
+    char c = block[i];
+    p |= (uint64_t) (c == separator || c == '\n' || c == '\r') << i;
+    e |= (uint64_t) (c == quote || c == '\n') << i;
+  }
 
-  table->error_callback = NULL;
+  *plain = p;
+  *escaped = e;
+}
 
-  table->separator = LIBCSV_DEFAULT_SEPARATOR;
+#ifdef LIBCSV_SIMD_X86
+__attribute__((target("sse2")))
+static void csv_scan_block_sse2(const char *block, char separator, char quote, uint64_t *plain, uint64_t *escaped) {
+  const __m128i v_separator = _mm_set1_epi8(separator);
+  const __m128i v_lf = _mm_set1_epi8('\n');
+  const __m128i v_cr = _mm_set1_epi8('\r');
+  const __m128i v_quote = _mm_set1_epi8(quote);
+  uint64_t p = 0, e = 0;
+
+  for (unsigned i = 0; i < LIBCSV_SCAN_BLOCK; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (block + i));
+    __m128i lf = _mm_cmpeq_epi8(v, v_lf);
+    __m128i vp = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, v_separator), _mm_cmpeq_epi8(v, v_cr)), lf);
+    __m128i ve = _mm_or_si128(_mm_cmpeq_epi8(v, v_quote), lf);
+
+    p |= (uint64_t) (uint16_t) _mm_movemask_epi8(vp) << i;
+    e |= (uint64_t) (uint16_t) _mm_movemask_epi8(ve) << i;
+  }
 
-  table->state = TABLE_STATE_NEWLINE;
-  table->state_line = 1;
-  table->state_column = 0;
-  table->state_cs = NULL;
-  table->state_cs_len = table->state_cs_cap = 0;
-  table->state_row = NULL;
-  table->state_row_column = 0;
+  *plain = p;
+  *escaped = e;
+}
 
-  table->has_header = false;
+__attribute__((target("avx2")))
+static void csv_scan_block_avx2(const char *block, char separator, char quote, uint64_t *plain, uint64_t *escaped) {
+  const __m256i v_separator = _mm256_set1_epi8(separator);
+  const __m256i v_lf = _mm256_set1_epi8('\n');
+  const __m256i v_cr = _mm256_set1_epi8('\r');
+  const __m256i v_quote = _mm256_set1_epi8(quote);
+  uint64_t p = 0, e = 0;
+
+  for (unsigned i = 0; i < LIBCSV_SCAN_BLOCK; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) (block + i));
+    __m256i lf = _mm256_cmpeq_epi8(v, v_lf);
+    __m256i vp = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, v_separator), _mm256_cmpeq_epi8(v, v_cr)), lf);
+    __m256i ve = _mm256_or_si256(_mm256_cmpeq_epi8(v, v_quote), lf);
+
+    p |= (uint64_t) (uint32_t) _mm256_movemask_epi8(vp) << i;
+    e |= (uint64_t) (uint32_t) _mm256_movemask_epi8(ve) << i;
+  }
 
-  table->columns_count = 0;
-  table->columns = NULL;
+  *plain = p;
+  *escaped = e;
+}
+#endif
 
-  table->rows_counter = 0;
-  table->rows_begin = 0;
-  table->rows_end = 0;
-  table->rows_capacity = 4;
-  table->rows_capacity_log = 2;
-  table->rows_capacity_mask = 0b11;
-  table->rows_queue = malloc(sizeof(table->rows_queue[0]) * table->rows_capacity);
+static csv_scan_block_function csv_scan_block_select() {
+#ifdef LIBCSV_SIMD_X86
+  __builtin_cpu_init();
 
-  return table;
+  if (__builtin_cpu_supports("avx2")) {
+    return csv_scan_block_avx2;
+  }
+
+  if (__builtin_cpu_supports("sse2")) {
+    return csv_scan_block_sse2;
+  }
+#endif
+
+  return csv_scan_block_scalar;
 }
 
-void csv_table_free(csv_table *table) {
-  if (table == NULL) {
-    return;
+static void csv_scanner_load(struct csv_scanner *scanner, const char *begin, const char *end) {
+  scanner->base = begin;
+
+  if (end - begin >= LIBCSV_SCAN_BLOCK) {
+    scanner->scan_block(begin, scanner->separator, scanner->quote, &scanner->plain, &scanner->escaped);
+  } else {
+    /* Tail of the data, pad it to the whole block and drop bits past the end */
+    char block[LIBCSV_SCAN_BLOCK] = {0};
+    size_t length = end - begin;
+    uint64_t valid = (UINT64_C(1) << length) - 1;
+
+    memcpy(block, begin, length);
+    scanner->scan_block(block, scanner->separator, scanner->quote, &scanner->plain, &scanner->escaped);
+    scanner->plain &= valid;
+    scanner->escaped &= valid;
   }
+}
 
-  for (
-    size_t i = table->rows_begin, end = table->rows_end, mask = table->rows_capacity_mask;
-    i != end;
-    ++i, i &= mask
-  ) {
-    csv_row_free(table->rows_queue[i]);
+/* Returns pointer to the next structural character (or end) */
+static LIBCSV_ALWAYS_INLINE const char *csv_scanner_next(
+  struct csv_scanner *scanner,
+  const char *begin,
+  const char *end,
+  bool escaped
+) {
+  for (;;) {
+    if (scanner->base == NULL || (size_t) (begin - scanner->base) >= LIBCSV_SCAN_BLOCK) {
+      csv_scanner_load(scanner, begin, end);
+    }
+
+    size_t shift = begin - scanner->base;
+    uint64_t mask = (escaped ? scanner->escaped : scanner->plain) >> shift;
+    if (mask != 0) {
+      return begin + count_trailing_zeros(mask);
+    }
+
+    begin = scanner->base + LIBCSV_SCAN_BLOCK;
+    if (begin >= end) {
+      return end;
+    }
   }
-  free(table->rows_queue);
+}
 
-  for (size_t i = table->columns_count; i --> 0; ) {
-    free(table->columns[i].name);
+
+/* Allocator */
+static void *csv_default_alloc(size_t size, void *context) {
+  (void) context;
+  return malloc(size);
+}
+
+static void *csv_default_realloc(void *ptr, size_t size, void *context) {
+  (void) context;
+  return realloc(ptr, size);
+}
+
+static void csv_default_free(void *ptr, void *context) {
+  (void) context;
+  free(ptr);
+}
+
+static const csv_allocator csv_default_allocator = {csv_default_alloc, csv_default_realloc, csv_default_free, NULL};
+
+static void *csv_alloc(const csv_allocator *allocator, size_t size) {
+  return (allocator->alloc)(size, allocator->context);
+}
+
+static void *csv_calloc(const csv_allocator *allocator, size_t count, size_t size) {
+  void *ptr = csv_alloc(allocator, count * size);
+  memset(ptr, 0, count * size);
+  return ptr;
+}
+
+static void *csv_realloc(const csv_allocator *allocator, void *ptr, size_t size) {
+  return (allocator->realloc)(ptr, size, allocator->context);
+}
+
+static void csv_free(const csv_allocator *allocator, void *ptr) {
+  if (ptr != NULL) {
+    (allocator->free)(ptr, allocator->context);
   }
-  free(table->columns);
+}
 
-  csv_row_free(table->state_row);
 
-  free(table->state_cs);
+/* Parsers */
 
-  free(table);
+static bool is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
 }
 
-void csv_table_set_error_callback(csv_table *table, csv_error_callback error_callback, void *data) {
-  table->error_callback = error_callback;
-  table->error_callback_data = data;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define LIBCSV_SWAR_DIGITS
+#endif
+
+#ifdef LIBCSV_SWAR_DIGITS
+static bool is_eight_digits(uint64_t chunk) {
+  return (
+    ((chunk & UINT64_C(0xF0F0F0F0F0F0F0F0)) |
+    (((chunk + UINT64_C(0x0606060606060606)) & UINT64_C(0xF0F0F0F0F0F0F0F0)) >> 4)) ==
+    UINT64_C(0x3333333333333333)
+  );
 }
 
-char csv_table_get_separator(const csv_table *table) {
-  return table->separator;
+/* Converts 8 ASCII digits (first one is the most significant) loaded as little-endian integer */
+static uint32_t parse_eight_digits(uint64_t chunk) {
+  const uint64_t mask = UINT64_C(0x000000FF000000FF);
+  const uint64_t mul1 = UINT64_C(100) + (UINT64_C(1000000) << 32);
+  const uint64_t mul2 = UINT64_C(1) + (UINT64_C(10000) << 32);
+
+  chunk -= UINT64_C(0x3030303030303030);
+  chunk = (chunk * 10) + (chunk >> 8);
+  chunk = (((chunk & mask) * mul1) + (((chunk >> 16) & mask) * mul2)) >> 32;
+  return (uint32_t) chunk;
 }
+#endif
 
-void csv_table_set_separator(csv_table *table, char separator) {
-  table->separator = separator;
+/* Parses non-empty sequence of decimal digits, fails on any other character or overflow */
+static bool parse_digits(const char *begin, const char *end, uint64_t *result) {
+  if (begin == end) {
+    return false;
+  }
+
+  const char *p = begin;
+  uint64_t value = 0;
+
+#ifdef LIBCSV_SWAR_DIGITS
+  /* Up to 16 digits can not overflow, take them by 8 at once */
+  while (end - p >= 8 && p - begin < 16) {
+    uint64_t chunk;
+    memcpy(&chunk, p, sizeof(chunk));
+    if (!is_eight_digits(chunk)) {
+      break;
+    }
+
+    value = value * 100000000 + parse_eight_digits(chunk);
+    p += 8;
+  }
+#endif
+
+  for (; p < end; ++p) {
+    unsigned digit = (unsigned char) *p - '0';
+    if (digit > 9 || value > (UINT64_MAX - digit) / 10) {
+      return false;
+    }
+
+    value = value * 10 + digit;
+  }
+
+  *result = value;
+  return true;
 }
 
-void csv_table_add_data(csv_table *table, const char *data) {
-  csv_table_add_data_length(table, data, strlen(data));
+bool csv_parse_int64(const char *data, size_t length, int64_t *result) {
+  const char *begin = data, *end = data + length;
+  bool negative = false;
+
+  while (begin < end && is_space(*begin)) {
+    ++begin;
+  }
+
+  if (begin < end && (*begin == '-' || *begin == '+')) {
+    negative = *begin == '-';
+    ++begin;
+  }
+
+  uint64_t value;
+  if (!parse_digits(begin, end, &value)) {
+    return false;
+  }
+
+  if (negative) {
+    if (value > (uint64_t) INT64_MAX + 1) {
+      return false;
+    }
+
+    *result = value == 0 ? 0 : -(int64_t) (value - 1) - 1;
+  } else {
+    if (value > INT64_MAX) {
+      return false;
+    }
+
+    *result = (int64_t) value;
+  }
+
+  return true;
 }
 
-static void csv_table_state_cs_put(csv_table *table, char c) {
-  if (table->state_cs_cap == 0) {
-    table->state_cs = malloc(LIBCSV_INITIAL_TMPSTR_BUFFER);
-    table->state_cs_cap = LIBCSV_INITIAL_TMPSTR_BUFFER;
+bool csv_parse_uint64(const char *data, size_t length, uint64_t *result) {
+  const char *begin = data, *end = data + length;
+
+  while (begin < end && is_space(*begin)) {
+    ++begin;
   }
 
-  if (table->state_cs_len >= table->state_cs_cap) {
-    table->state_cs_cap *= 2;
-    table->state_cs = realloc(table->state_cs, table->state_cs_cap);
+  if (begin < end && *begin == '+') {
+    ++begin;
   }
 
-  table->state_cs[table->state_cs_len] = c;
-  ++table->state_cs_len;
+  return parse_digits(begin, end, result);
 }
 
-static void csv_table_state_cs_flush(csv_table *table, bool trim) {
-  size_t old_len = table->state_cs_len;
-  char *state_cs = table->state_cs;
-  size_t len = table->state_cs_len;
 
-  if (len != 0 && trim) {
-    for (; len --> 0; ) {
-      if (state_cs[len] != ' ' && state_cs[len] != '\t') {
-        break;
-      }
+/*
+ * Floating point numbers are parsed into decimal mantissa (up to 19 digits) and exponent, which are then converted by
+ * exact arithmetic when both are small (Clinger's fast path) or by Eisel-Lemire algorithm. Remaining cases (too many
+ * digits to decide rounding) are handed to strtod with locale's decimal point.
+ */
+
+struct csv_decimal {
+  bool negative;
+  bool too_many_digits;
+  int64_t exponent;
+  uint64_t mantissa;
+};
+
+struct csv_float_format {
+  int mantissa_bits; /* explicit ones */
+  int minimum_exponent;
+  int infinite_power;
+  int min_exponent_round_to_even;
+  int max_exponent_round_to_even;
+  int smallest_power_of_ten;
+  int largest_power_of_ten;
+};
+
+static const struct csv_float_format csv_binary64 = {52, -1023, 0x7FF, -4, 23, -342, 308};
+static const struct csv_float_format csv_binary32 = {23, -127, 0xFF, -17, 10, -65, 38};
+
+static const double csv_double_powers_of_ten[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static const float csv_float_powers_of_ten[] = {
+  1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f,
+};
+
+static uint64_t multiply_high(uint64_t a, uint64_t b, uint64_t *low) {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 product = (unsigned __int128) a * b;
+  *low = (uint64_t) product;
+  return (uint64_t) (product >> 64);
+#else
+  uint64_t a_lo = (uint32_t) a, a_hi = a >> 32;
+  uint64_t b_lo = (uint32_t) b, b_hi = b >> 32;
+  uint64_t p0 = a_lo * b_lo, p1 = a_lo * b_hi, p2 = a_hi * b_lo, p3 = a_hi * b_hi;
+  uint64_t cross = (p0 >> 32) + (uint32_t) p1 + p2;
+
+  *low = (cross << 32) | (uint32_t) p0;
+  return (p1 >> 32) + (cross >> 32) + p3;
+#endif
+}
+
+static bool is_digit(char c) {
+  return (unsigned char) (c - '0') <= 9;
+}
+
+/* Parses [+-]digits[.digits][(e|E)[+-]digits], which must take whole input */
+static bool parse_decimal(const char *begin, const char *end, struct csv_decimal *decimal) {
+  const char *p = begin;
+
+  decimal->negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    decimal->negative = *p == '-';
+    ++p;
+  }
+
+  const char *integer_begin = p;
+  uint64_t mantissa = 0;
+  for (; p < end && is_digit(*p); ++p) {
+    mantissa = mantissa * 10 + (uint64_t) (*p - '0'); /* may overflow, checked below */
+  }
+  const char *integer_end = p;
+  int64_t digits = integer_end - integer_begin;
+
+  const char *fraction_begin = p, *fraction_end = p;
+  if (p < end && *p == '.') {
+    ++p;
+    fraction_begin = p;
+    for (; p < end && is_digit(*p); ++p) {
+      mantissa = mantissa * 10 + (uint64_t) (*p - '0');
     }
-    ++len;
+    fraction_end = p;
+    digits += fraction_end - fraction_begin;
   }
 
-  char *str = malloc(len + 1);
-  memcpy(str, table->state_cs, len);
-  str[len] = '\0';
-  table->state_cs_len = 0;
+  if (digits == 0) {
+    return false;
+  }
 
-  if (!table->has_header) {
-    table->columns = realloc(table->columns, (table->columns_count + 1) * sizeof(csv_column));
-    csv_column *col = &table->columns[table->columns_count];
+  int64_t exponent_number = 0;
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    ++p;
 
-    col->table = table;
-    col->index = table->columns_count;
-    col->name = str;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+      negative = *p == '-';
+      ++p;
+    }
 
-    ++table->columns_count;
-  } else {
-    csv_row *state_row = table->state_row;
-    if (state_row == NULL) {
-      state_row = malloc(sizeof(csv_row) + sizeof(table->state_row->values[0]) * table->columns_count);
-      state_row->table = table;
-      state_row->index = table->rows_counter;
-      for (size_t i = table->columns_count; i --> 0; ) {
-        state_row->values[i] = NULL;
-      }
-
-      ++table->rows_counter;
-      table->state_row = state_row;
-      table->state_row_column = 0;
-    }
-
-    if (table->state_row_column >= table->columns_count) {
-      if (table->error_callback != NULL) {
-        (table->error_callback)(
-          "Unexpected extra column",
-          table->state_line,
-          table->state_column - old_len,
-          table->error_callback_data
-        );
+    if (p == end || !is_digit(*p)) {
+      return false;
+    }
+
+    for (; p < end && is_digit(*p); ++p) {
+      if (exponent_number < 0x10000) {
+        exponent_number = exponent_number * 10 + (*p - '0');
       }
-      free(str);
-      return;
     }
 
-    state_row->values[table->state_row_column] = str;
-    ++table->state_row_column;
+    if (negative) {
+      exponent_number = -exponent_number;
+    }
+  }
+
+  if (p != end) {
+    return false;
+  }
+
+  decimal->too_many_digits = false;
+  decimal->exponent = exponent_number - (fraction_end - fraction_begin);
+
+  if (digits > 19) {
+    /* Leading zeros are not significant */
+    for (const char *q = integer_begin; q < fraction_end && (*q == '0' || *q == '.'); ++q) {
+      if (*q == '0') {
+        --digits;
+      }
+    }
+  }
+
+  if (digits > 19) {
+    /* Keep 19 most significant digits, the result is then checked to be the same for the next mantissa */
+    const uint64_t minimal_nineteen_digits = UINT64_C(1000000000000000000);
+
+    decimal->too_many_digits = true;
+    mantissa = 0;
+
+    const char *q = integer_begin;
+    for (; mantissa < minimal_nineteen_digits && q < integer_end; ++q) {
+      mantissa = mantissa * 10 + (uint64_t) (*q - '0');
+    }
+
+    if (mantissa >= minimal_nineteen_digits) {
+      decimal->exponent = (integer_end - q) + exponent_number;
+    } else {
+      q = fraction_begin;
+      for (; mantissa < minimal_nineteen_digits && q < fraction_end; ++q) {
+        mantissa = mantissa * 10 + (uint64_t) (*q - '0');
+      }
+      decimal->exponent = (fraction_begin - q) + exponent_number;
+    }
   }
+
+  decimal->mantissa = mantissa;
+  return true;
 }
 
-static void csv_table_state_flush_row(csv_table *table) {
-  if (!table->has_header) {
-    if (table->columns_count == 0) {
-      return;
+/* Eisel-Lemire: returns biased exponent (negative if it can not be computed) and mantissa without implicit bit */
+static int32_t compute_float(const struct csv_float_format *format, int64_t q, uint64_t w, uint64_t *mantissa) {
+  if (w == 0 || q < format->smallest_power_of_ten) {
+    *mantissa = 0;
+    return 0;
+  }
+
+  if (q > format->largest_power_of_ten) {
+    *mantissa = 0;
+    return format->infinite_power;
+  }
+
+  int lz = (int) count_leading_zeros(w);
+  w <<= lz;
+
+  size_t index = 2 * (size_t) (q - LIBCSV_POW5_MIN);
+  uint64_t low, high = multiply_high(w, csv_pow5_128[index], &low);
+  uint64_t precision_mask = UINT64_MAX >> (format->mantissa_bits + 3);
+  if ((high & precision_mask) == precision_mask) {
+    uint64_t second_low, second_high = multiply_high(w, csv_pow5_128[index + 1], &second_low);
+    low += second_high;
+    if (second_high > low) {
+      ++high;
     }
+  }
 
-    table->has_header = true;
-  } else if (table->state_row != NULL) {
-    if (table->state_row_column == 0) {
-      return;
+  int upper_bit = (int) (high >> 63);
+  int shift = upper_bit + 64 - format->mantissa_bits - 3;
+  uint64_t m = high >> shift;
+  int32_t power2 = (int32_t) ((((152170 + 65536) * q) >> 16) + 63 + upper_bit - lz - format->minimum_exponent);
+
+  if (power2 <= 0) {
+    /* Subnormal */
+    if (-power2 + 1 >= 64) {
+      *mantissa = 0;
+      return 0;
     }
 
-    if (((table->rows_end + 1) & table->rows_capacity_mask) == table->rows_begin) {
-      size_t old_mask = table->rows_capacity_mask;
+    m >>= -power2 + 1;
+    m += m & 1;
+    m >>= 1;
+    *mantissa = m;
+    return m < (UINT64_C(1) << format->mantissa_bits) ? 0 : 1;
+  }
+
+  /* Exactly in between of two floats, round to even */
+  if (
+    low <= 1 &&
+    q >= format->min_exponent_round_to_even &&
+    q <= format->max_exponent_round_to_even &&
+    (m & 3) == 1 &&
+    (m << shift) == high
+  ) {
+    m &= ~UINT64_C(1);
+  }
+
+  m += m & 1;
+  m >>= 1;
+  if (m >= (UINT64_C(2) << format->mantissa_bits)) {
+    m = UINT64_C(1) << format->mantissa_bits;
+    ++power2;
+  }
+
+  m &= ~(UINT64_C(1) << format->mantissa_bits);
+  if (power2 >= format->infinite_power) {
+    power2 = format->infinite_power;
+    m = 0;
+  }
 
-      table->rows_capacity <<= 1; /* *= 2 */
-      ++table->rows_capacity_log;
-      table->rows_capacity_mask = (table->rows_capacity_mask << 1) | 1;
+  *mantissa = m;
+  return power2;
+}
 
-      csv_row **new_rows = malloc(sizeof(csv_row *) * table->rows_capacity);
-      size_t rows_count = 0;
-      for (size_t i = 0, j = table->rows_begin; j != table->rows_end; ++i, ++j, j &= old_mask) {
-        new_rows[i] = table->rows_queue[j];
-        ++rows_count;
-      }
+/* Same as compute_float, but checks whether truncated digits could change the result */
+static int32_t compute_decimal(const struct csv_float_format *format, const struct csv_decimal *decimal, uint64_t *mantissa) {
+  int32_t power2 = compute_float(format, decimal->exponent, decimal->mantissa, mantissa);
 
-      free(table->rows_queue);
-      table->rows_queue = new_rows;
-      table->rows_begin = 0;
-      table->rows_end = rows_count;
+  if (decimal->too_many_digits) {
+    uint64_t next_mantissa;
+    int32_t next_power2 = compute_float(format, decimal->exponent, decimal->mantissa + 1, &next_mantissa);
+    if (next_power2 != power2 || next_mantissa != *mantissa) {
+      return -1;
     }
+  }
 
-    table->rows_queue[table->rows_end] = table->state_row;
-    table->state_row = NULL;
-    table->state_row_column = 0;
+  return power2;
+}
 
-    ++table->rows_end;
-    table->rows_end &= table->rows_capacity_mask;
+static bool equals_ignore_case_length(const char *a, size_t length, const char *b) {
+  for (; length != 0; --length, ++a, ++b) {
+    if (*b == '\0' || convert_to_lower(*a) != convert_to_lower(*b)) {
+      return false;
+    }
   }
+
+  return *b == '\0';
 }
 
-void csv_table_add_data_length(csv_table *table, const char *data, size_t length) {
-  const char *begin = data, *end = data + length;
-  enum csv_table_state state = table->state;
+/* Parses inf, infinity and nan */
+static bool parse_special(const char *begin, const char *end, double *result) {
+  bool negative = false;
+  if (begin < end && (*begin == '-' || *begin == '+')) {
+    negative = *begin == '-';
+    ++begin;
+  }
 
-  while (begin < end) {
-    const char *cp = begin;
-    char c = *begin;
+  size_t length = end - begin;
+  if (equals_ignore_case_length(begin, length, "inf") || equals_ignore_case_length(begin, length, "infinity")) {
+    *result = negative ? -INFINITY : INFINITY;
+    return true;
+  }
 
-    switch (state) {
-    case TABLE_STATE_NEWLINE:
-      if (c != '\n' && c != '\r') {
-        state = TABLE_STATE_COLUMN_BEGIN;
-        --begin;
-      }
-      break;
+  if (equals_ignore_case_length(begin, length, "nan")) {
+    *result = negative ? -NAN : NAN;
+    return true;
+  }
 
-    case TABLE_STATE_COLUMN_BEGIN:
-      if (c  == ' ' || c == '\t') {
-        /* Skip whitespace */
-      } else if (c == '\n' || c == '\r') {
-        csv_table_state_cs_flush(table, true);
+  return false;
+}
+
+/* Slow path, converts with strtod/strtof, replacing '.' with decimal point of current locale */
+static bool parse_float_fallback(
+  const csv_allocator *allocator,
+  const char *begin,
+  const char *end,
+  bool single,
+  double *result
+) {
+  const char *point = localeconv()->decimal_point;
+  size_t point_length = strlen(point);
+  size_t size = (end - begin) * (point_length + 1) + 1;
+  char buffer[LIBCSV_NUMBER_BUFFER];
+  char *str = size <= sizeof(buffer) ? buffer : csv_alloc(allocator, size);
+  char *out = str;
+
+  for (const char *p = begin; p < end; ++p) {
+    if (*p == '.') {
+      memcpy(out, point, point_length);
+      out += point_length;
+    } else {
+      *out = *p;
+      ++out;
+    }
+  }
+  *out = '\0';
+
+  char *parsed_end;
+  if (single) {
+    *result = strtof(str, &parsed_end);
+  } else {
+    *result = strtod(str, &parsed_end);
+  }
+  bool ok = parsed_end == out;
+
+  if (str != buffer) {
+    csv_free(allocator, str);
+  }
+
+  return ok;
+}
+
+/* Same as csv_parse_double, but memory for the slow path is taken from allocator */
+static bool csv_parse_double_with_allocator(
+  const csv_allocator *allocator,
+  const char *data,
+  size_t length,
+  double *result
+) {
+  const char *begin = data, *end = data + length;
+
+  while (begin < end && is_space(*begin)) {
+    ++begin;
+  }
+
+  struct csv_decimal decimal;
+  if (!parse_decimal(begin, end, &decimal)) {
+    return parse_special(begin, end, result);
+  }
+
+#if FLT_EVAL_METHOD == 0
+  if (
+    !decimal.too_many_digits &&
+    decimal.exponent >= -22 &&
+    decimal.exponent <= 22 &&
+    decimal.mantissa <= (UINT64_C(1) << 53)
+  ) {
+    double value = (double) decimal.mantissa;
+    if (decimal.exponent < 0) {
+      value /= csv_double_powers_of_ten[-decimal.exponent];
+    } else {
+      value *= csv_double_powers_of_ten[decimal.exponent];
+    }
+
+    *result = decimal.negative ? -value : value;
+    return true;
+  }
+#endif
+
+  uint64_t mantissa;
+  int32_t power2 = compute_decimal(&csv_binary64, &decimal, &mantissa);
+  if (power2 < 0) {
+    return parse_float_fallback(allocator, begin, end, false, result);
+  }
+
+  uint64_t bits = mantissa | ((uint64_t) power2 << 52) | ((uint64_t) decimal.negative << 63);
+  memcpy(result, &bits, sizeof(*result));
+  return true;
+}
+
+static bool csv_parse_float_with_allocator(
+  const csv_allocator *allocator,
+  const char *data,
+  size_t length,
+  float *result
+) {
+  const char *begin = data, *end = data + length;
+
+  while (begin < end && is_space(*begin)) {
+    ++begin;
+  }
+
+  struct csv_decimal decimal;
+  if (!parse_decimal(begin, end, &decimal)) {
+    double value;
+    if (!parse_special(begin, end, &value)) {
+      return false;
+    }
+
+    *result = (float) value;
+    return true;
+  }
+
+#if FLT_EVAL_METHOD == 0
+  if (
+    !decimal.too_many_digits &&
+    decimal.exponent >= -10 &&
+    decimal.exponent <= 10 &&
+    decimal.mantissa <= (UINT64_C(1) << 24)
+  ) {
+    float value = (float) decimal.mantissa;
+    if (decimal.exponent < 0) {
+      value /= csv_float_powers_of_ten[-decimal.exponent];
+    } else {
+      value *= csv_float_powers_of_ten[decimal.exponent];
+    }
+
+    *result = decimal.negative ? -value : value;
+    return true;
+  }
+#endif
+
+  uint64_t mantissa;
+  int32_t power2 = compute_decimal(&csv_binary32, &decimal, &mantissa);
+  if (power2 < 0) {
+    double value;
+    if (!parse_float_fallback(allocator, begin, end, true, &value)) {
+      return false;
+    }
+
+    *result = (float) value;
+    return true;
+  }
+
+  uint32_t bits = (uint32_t) mantissa | ((uint32_t) power2 << 23) | ((uint32_t) decimal.negative << 31);
+  memcpy(result, &bits, sizeof(*result));
+  return true;
+}
+
+bool csv_parse_double(const char *data, size_t length, double *result) {
+  return csv_parse_double_with_allocator(&csv_default_allocator, data, length, result);
+}
+
+bool csv_parse_float(const char *data, size_t length, float *result) {
+  return csv_parse_float_with_allocator(&csv_default_allocator, data, length, result);
+}
+
+bool csv_parse_bool(const char *data, size_t length, bool *result) {
+  static const char *truth_values[] = {
+    "1",
+    "t",
+    "true",
+    "ok",
+    "okay",
+    "yes",
+    "yep",
+    "yeah",
+    NULL,
+  };
+
+  static const char *falsy_values[] = {
+    "0",
+    "f",
+    "false",
+    "not",
+    "no",
+    "nope",
+    "never",
+    NULL,
+  };
+
+  for (const char **truth_value = truth_values; *truth_value; ++truth_value) {
+    if (equals_ignore_case_length(data, length, *truth_value)) {
+      *result = true;
+      return true;
+    }
+  }
+
+  for (const char **falsy_value = falsy_values; *falsy_value; ++falsy_value) {
+    if (equals_ignore_case_length(data, length, *falsy_value)) {
+      *result = false;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+enum csv_table_state {
+  TABLE_STATE_NEWLINE,
+
+  TABLE_STATE_COLUMN_BEGIN,
+  TABLE_STATE_COLUMN_IN,
+  TABLE_STATE_COLUMN_IN_ESCAPE,
+  TABLE_STATE_COLUMN_IN_ESCAPE_ESCAPE,
+  TABLE_STATE_COLUMN_IN_ESCAPE_END,
+};
+
+/* Input buffer, passed to csv_table_add_data_retained, referenced by the values of rows */
+struct csv_chunk {
+  atomic_size_t references; /* released by consumer thread, if rows are passed through channel */
+  const csv_allocator *allocator; /* of table */
+  const char *data;
+  size_t length;
+  csv_release_callback release;
+  void *release_data;
+};
+
+/* Beginning of recorded row, which is parsed from the newline before it. Stored as is in sidecar index file */
+struct csv_checkpoint {
+  uint64_t offset; /* of the newline, counted from the beginning of input */
+  uint64_t line;
+};
+
+struct csv_table {
+  csv_error_callback error_callback;
+  void *error_callback_data;
+
+  csv_row_callback row_callback; /* rows are passed to it instead of the queue, if it is not NULL */
+  void *row_callback_data;
+
+  csv_dialect dialect;
+  csv_scan_block_function scan_block;
+  size_t thread_count;
+
+  enum csv_table_state state;
+  size_t state_line, state_column;
+  size_t state_offset; /* of data being parsed, counted from the beginning of input */
+  char *state_cs; /* values of the current row, each one NUL-terminated */
+  size_t state_cs_len, state_cs_cap;
+  size_t state_cs_field; /* offset of the current column in state_cs */
+  struct csv_chunk *state_chunk;
+  size_t state_chunk_references; /* references to state_chunk, added to it when the chunk is parsed */
+  const char *state_view_begin, *state_view_end;
+  struct csv_value *state_values;
+  size_t state_row_column;
+  bool state_skip; /* current column is not projected, so its characters are not stored */
+
+  bool has_header;
+
+  size_t columns_count;
+  csv_column *columns;
+  size_t *columns_index; /* open addressing hash table of column indices + 1 (0 is empty slot) */
+  size_t columns_index_mask;
+  bool *columns_projected; /* NULL if all columns are projected */
+  csv_type *columns_types; /* NULL if all columns are strings */
+  bool columns_types_fixed; /* once a row is built, as its values are read according to the types */
+
+  size_t rows_counter;
+  size_t rows_begin;
+  size_t rows_end;
+  size_t rows_capacity; /* = 2^rows_capacity_log */
+  size_t rows_capacity_log; /* = log2 rows_capacity */
+  size_t rows_capacity_mask; /* = (~0) >> (sizeof(rows_capacity_mask) * 8 - rows_capacity_log) */
+  csv_row **rows_queue;
+  csv_channel *channel; /* rows are pushed into it instead of the queue, if it is not NULL */
+  size_t rows_max; /* csv_table_feed stops once queue has so many rows, 0 if not limited */
+  size_t rows_skip; /* rows before it are dropped, set by csv_table_seek_row */
+
+  /* Rows are stored in batches instead of the queue, if batch_size is not 0 */
+  size_t batch_size;
+  csv_batch *batch; /* being filled */
+  csv_batch *batches_begin, *batches_end;
+
+  /* Freed rows, kept for reuse */
+  size_t pool_count;
+  size_t pool_capacity;
+  size_t pool_size; /* bytes held by pooled rows */
+  size_t pool_limit;
+  csv_row **pool_rows;
+
+  /* Checkpoints of rows 0, index_interval, 2 * index_interval and so on */
+  size_t index_interval;
+  size_t index_next; /* rows_counter of the next checkpoint, SIZE_MAX if index is not recorded */
+  size_t index_count;
+  size_t index_capacity;
+  struct csv_checkpoint *index; /* points into index_file, if it is loaded from sidecar */
+  struct csv_chunk *index_file;
+  size_t index_rows; /* rows_counter once the latest retained data is parsed */
+  struct csv_chunk *index_source; /* the latest retained data, referenced for csv_table_seek_row */
+  size_t index_source_offset; /* of its beginning */
+  size_t index_source_position; /* where its parsing has stopped */
+
+  csv_allocator allocator;
+
+#ifdef LIBCSV_STATS
+  csv_stats stats;
+#endif
+};
+
+struct csv_column {
+  csv_table *table;
+  size_t index;
+  char *name;
+};
+
+struct csv_value {
+  union {
+    const char *data;
+
+    /* Value of typed column */
+    int64_t i64;
+    uint64_t u64;
+    float f32;
+    double f64;
+    bool b;
+  };
+  size_t length; /* 1 if typed column has value, 0 otherwise */
+  struct csv_chunk *chunk; /* NULL if data is owned by row */
+};
+
+struct csv_batch_column {
+  char *data;
+  size_t length;
+  size_t capacity;
+  size_t *offsets; /* value of row i is from offsets[i] to offsets[i + 1] */
+  uint8_t *validity; /* bit i % 8 of byte i / 8 is set if row i has value */
+};
+
+struct csv_batch {
+  csv_allocator allocator; /* copied, so batch outlives table */
+  csv_batch *next;
+  size_t index; /* of the first row */
+  size_t rows_count;
+  size_t columns_count;
+  struct csv_batch_column columns[0];
+};
+
+/* Rows, which are pushed by producer once and then taken by consumer */
+struct csv_channel_segment {
+  atomic_size_t written;
+  _Atomic(struct csv_channel_segment *) next; /* set once segment is full */
+  size_t capacity;
+  csv_row *rows[0];
+};
+
+/* Single-producer single-consumer queue of rows, a list of segments, so it grows without blocking consumer */
+struct csv_channel {
+  const csv_allocator *allocator; /* of table */
+
+  /* Producer */
+  struct csv_channel_segment *tail;
+  size_t tail_written;
+  char producer_padding[LIBCSV_CACHE_LINE];
+
+  /* Consumer */
+  struct csv_channel_segment *head;
+  size_t head_read;
+  char consumer_padding[LIBCSV_CACHE_LINE];
+
+  _Atomic(struct csv_channel_segment *) spare; /* consumed segment, kept for reuse by producer */
+  atomic_bool closed;
+  atomic_bool waiting; /* consumer sleeps on condition */
+#ifdef LIBCSV_HAVE_PTHREAD
+  pthread_mutex_t mutex;
+  pthread_cond_t condition;
+#endif
+};
+
+struct csv_row {
+  csv_table *table;
+  size_t index;
+  size_t capacity; /* size of allocated block */
+  struct csv_value values[0];
+};
+
+
+static struct csv_chunk *csv_chunk_create(
+  const csv_allocator *allocator,
+  const char *data,
+  size_t length,
+  csv_release_callback release,
+  void *release_data
+) {
+  struct csv_chunk *chunk = csv_alloc(allocator, sizeof(struct csv_chunk));
+  atomic_init(&chunk->references, 1);
+  chunk->allocator = allocator;
+  chunk->data = data;
+  chunk->length = length;
+  chunk->release = release;
+  chunk->release_data = release_data;
+  return chunk;
+}
+
+static void csv_chunk_release(struct csv_chunk *chunk) {
+  if (atomic_fetch_sub_explicit(&chunk->references, 1, memory_order_acq_rel) != 1) {
+    return;
+  }
+
+  if (chunk->release != NULL) {
+    (chunk->release)(chunk->data, chunk->length, chunk->release_data);
+  }
+
+  csv_free(chunk->allocator, chunk);
+}
+
+/* Releases reference of value, which is not added to the chunk yet if the chunk is being parsed */
+static void csv_table_release_chunk(csv_table *table, struct csv_chunk *chunk) {
+  if (chunk == table->state_chunk) {
+    --table->state_chunk_references;
+  } else {
+    csv_chunk_release(chunk);
+  }
+}
+
+
+/* Table */
+csv_table *csv_table_create() {
+  return csv_table_create_with_allocator(NULL);
+}
+
+csv_table *csv_table_create_with_allocator(const csv_allocator *allocator) {
+  if (allocator == NULL) {
+    allocator = &csv_default_allocator;
+  }
+
+  csv_table *table = csv_alloc(allocator, sizeof(csv_table));
+
+  table->allocator = *allocator;
+  table->error_callback = NULL;
+  table->row_callback = NULL;
+
+  table->dialect = (csv_dialect) {
+    .separator = LIBCSV_DEFAULT_SEPARATOR,
+    .quote = '"',
+    .trim = true,
+    .cr_newline = true,
+  };
+  table->scan_block = csv_scan_block_select();
+  table->thread_count = 1;
+
+  table->state = TABLE_STATE_NEWLINE;
+  table->state_line = 1;
+  table->state_column = 0;
+  table->state_offset = 0;
+  table->state_cs = NULL;
+  table->state_cs_len = table->state_cs_cap = 0;
+  table->state_chunk = NULL;
+  table->state_chunk_references = 0;
+  table->state_view_begin = table->state_view_end = NULL;
+  table->state_cs_field = 0;
+  table->state_values = NULL;
+  table->state_row_column = 0;
+  table->state_skip = false;
+
+  table->has_header = false;
+
+  table->columns_count = 0;
+  table->columns = NULL;
+  table->columns_index = NULL;
+  table->columns_index_mask = 0;
+  table->columns_projected = NULL;
+  table->columns_types = NULL;
+  table->columns_types_fixed = false;
+
+  table->rows_counter = 0;
+  table->rows_begin = 0;
+  table->rows_end = 0;
+  table->rows_capacity = 4;
+  table->rows_capacity_log = 2;
+  table->rows_capacity_mask = 0b11;
+  table->rows_queue = csv_alloc(allocator, sizeof(table->rows_queue[0]) * table->rows_capacity);
+  table->channel = NULL;
+  table->rows_max = 0;
+  table->rows_skip = 0;
+
+  table->batch_size = 0;
+  table->batch = NULL;
+  table->batches_begin = table->batches_end = NULL;
+
+  table->pool_count = 0;
+  table->pool_capacity = 0;
+  table->pool_size = 0;
+  table->pool_limit = LIBCSV_DEFAULT_ROW_POOL_LIMIT;
+  table->pool_rows = NULL;
+
+  table->index_interval = 0;
+  table->index_next = SIZE_MAX;
+  table->index_count = 0;
+  table->index_capacity = 0;
+  table->index = NULL;
+  table->index_file = NULL;
+  table->index_rows = 0;
+  table->index_source = NULL;
+  table->index_source_offset = 0;
+  table->index_source_position = 0;
+
+#ifdef LIBCSV_STATS
+  memset(&table->stats, 0, sizeof(table->stats));
+#endif
+
+  return table;
+}
+
+static void csv_channel_free(csv_channel *channel) {
+  if (channel == NULL) {
+    return;
+  }
+
+  csv_row *row;
+  while ((row = csv_channel_try_next_row(channel)) != NULL) {
+    csv_row_free(row);
+  }
+
+  csv_free(channel->allocator, channel->head);
+  csv_free(channel->allocator, atomic_load(&channel->spare));
+#ifdef LIBCSV_HAVE_PTHREAD
+  pthread_mutex_destroy(&channel->mutex);
+  pthread_cond_destroy(&channel->condition);
+#endif
+  csv_free(channel->allocator, channel);
+}
+
+void csv_table_free(csv_table *table) {
+  if (table == NULL) {
+    return;
+  }
+
+  for (
+    size_t i = table->rows_begin, end = table->rows_end, mask = table->rows_capacity_mask;
+    i != end;
+    ++i, i &= mask
+  ) {
+    csv_row_free(table->rows_queue[i]);
+  }
+  csv_free(&table->allocator, table->rows_queue);
+
+  csv_channel_free(table->channel);
+
+  while (table->batches_begin != NULL) {
+    csv_batch *batch = table->batches_begin;
+    table->batches_begin = batch->next;
+    csv_batch_free(batch);
+  }
+  csv_batch_free(table->batch);
+
+  const csv_allocator *allocator = &table->allocator;
+
+  for (size_t i = table->pool_count; i --> 0; ) {
+    csv_free(allocator, table->pool_rows[i]);
+  }
+  csv_free(allocator, table->pool_rows);
+
+  for (size_t i = table->columns_count; i --> 0; ) {
+    csv_free(allocator, table->columns[i].name);
+  }
+  csv_free(allocator, table->columns);
+  csv_free(allocator, table->columns_index);
+  csv_free(allocator, table->columns_projected);
+  csv_free(allocator, table->columns_types);
+
+  for (size_t i = table->state_row_column; i --> 0; ) {
+    if (table->state_values[i].chunk != NULL) {
+      csv_chunk_release(table->state_values[i].chunk);
+    }
+  }
+  csv_free(allocator, table->state_values);
+
+  csv_free(allocator, table->state_cs);
+
+  if (table->index_file != NULL) {
+    csv_chunk_release(table->index_file);
+  } else {
+    csv_free(allocator, table->index);
+  }
+  if (table->index_source != NULL) {
+    csv_chunk_release(table->index_source);
+  }
+
+  csv_allocator copy = *allocator;
+  csv_free(&copy, table);
+}
+
+void csv_table_set_error_callback(csv_table *table, csv_error_callback error_callback, void *data) {
+  table->error_callback = error_callback;
+  table->error_callback_data = data;
+}
+
+void csv_table_set_row_callback(csv_table *table, csv_row_callback row_callback, void *data) {
+  table->row_callback = row_callback;
+  table->row_callback_data = data;
+}
+
+size_t csv_table_get_row_pool_limit(const csv_table *table) {
+  return table->pool_limit;
+}
+
+void csv_table_set_row_pool_limit(csv_table *table, size_t limit) {
+  table->pool_limit = limit;
+
+  while (table->pool_count != 0 && table->pool_size > limit) {
+    --table->pool_count;
+    table->pool_size -= table->pool_rows[table->pool_count]->capacity;
+    csv_free(&table->allocator, table->pool_rows[table->pool_count]);
+  }
+}
+
+char csv_table_get_separator(const csv_table *table) {
+  return table->dialect.separator;
+}
+
+void csv_table_set_separator(csv_table *table, char separator) {
+  table->dialect.separator = separator;
+}
+
+csv_dialect csv_table_get_dialect(const csv_table *table) {
+  return table->dialect;
+}
+
+static bool csv_dialect_valid(csv_dialect dialect) {
+  return !(
+    dialect.separator == dialect.quote ||
+    dialect.separator == '\n' || dialect.quote == '\n' ||
+    (dialect.cr_newline && (dialect.separator == '\r' || dialect.quote == '\r'))
+  );
+}
+
+bool csv_table_set_dialect(csv_table *table, csv_dialect dialect) {
+  if (!csv_dialect_valid(dialect)) {
+    return false;
+  }
+
+  table->dialect = dialect;
+  return true;
+}
+
+size_t csv_table_get_thread_count(const csv_table *table) {
+  return table->thread_count;
+}
+
+void csv_table_set_thread_count(csv_table *table, size_t count) {
+  table->thread_count = count == 0 ? 1 : count;
+}
+
+size_t csv_table_get_max_queued_rows(const csv_table *table) {
+  return table->rows_max;
+}
+
+void csv_table_set_max_queued_rows(csv_table *table, size_t count) {
+  table->rows_max = count;
+}
+
+size_t csv_table_get_batch_size(const csv_table *table) {
+  return table->batch_size;
+}
+
+bool csv_table_set_batch_size(csv_table *table, size_t size) {
+  if (table->state != TABLE_STATE_NEWLINE) {
+    return false;
+  }
+
+  csv_table_flush_batch(table);
+  table->batch_size = size;
+  return true;
+}
+
+void csv_table_add_data(csv_table *table, const char *data) {
+  csv_table_add_data_length(table, data, strlen(data));
+}
+
+static void csv_table_state_cs_grow(csv_table *table, size_t required) {
+  size_t cap = table->state_cs_cap == 0 ? LIBCSV_INITIAL_TMPSTR_BUFFER : table->state_cs_cap;
+  while (cap < required) {
+    cap *= 2;
+  }
+
+  table->state_cs = csv_realloc(&table->allocator, table->state_cs, cap);
+  table->state_cs_cap = cap;
+
+  LIBCSV_STAT_ADD(table, buffer_regrowths, 1);
+  LIBCSV_STAT_ADD(table, bytes_allocated, cap);
+}
+
+static void csv_table_state_cs_reserve(csv_table *table, size_t length) {
+  size_t required = table->state_cs_len + length;
+  if (required > table->state_cs_cap) {
+    csv_table_state_cs_grow(table, required);
+  }
+}
+
+static void csv_table_state_cs_put_length(csv_table *table, const char *data, size_t length) {
+  csv_table_state_cs_reserve(table, length);
+
+  memcpy(table->state_cs + table->state_cs_len, data, length);
+  table->state_cs_len += length;
+}
+
+static void csv_table_state_view_materialize(csv_table *table) {
+  const char *begin = table->state_view_begin, *end = table->state_view_end;
+
+  table->state_view_begin = table->state_view_end = NULL;
+  csv_table_state_cs_put_length(table, begin, end - begin);
+}
+
+static csv_type csv_table_column_type(const csv_table *table, size_t index) {
+  return table->columns_types == NULL ? CSV_TYPE_STRING : table->columns_types[index];
+}
+
+/* Converts characters of value of typed column, checking that it is in range of type */
+static bool csv_value_convert(
+  const csv_allocator *allocator,
+  struct csv_value *value,
+  csv_type type,
+  const char *data,
+  size_t length
+) {
+  switch (type) {
+  case CSV_TYPE_STRING:
+    break;
+
+  case CSV_TYPE_INT8:
+    return csv_parse_int64(data, length, &value->i64) && value->i64 >= INT8_MIN && value->i64 <= INT8_MAX;
+  case CSV_TYPE_INT16:
+    return csv_parse_int64(data, length, &value->i64) && value->i64 >= INT16_MIN && value->i64 <= INT16_MAX;
+  case CSV_TYPE_INT32:
+    return csv_parse_int64(data, length, &value->i64) && value->i64 >= INT32_MIN && value->i64 <= INT32_MAX;
+  case CSV_TYPE_INT64:
+    return csv_parse_int64(data, length, &value->i64);
+
+  case CSV_TYPE_UINT8:
+    return csv_parse_uint64(data, length, &value->u64) && value->u64 <= UINT8_MAX;
+  case CSV_TYPE_UINT16:
+    return csv_parse_uint64(data, length, &value->u64) && value->u64 <= UINT16_MAX;
+  case CSV_TYPE_UINT32:
+    return csv_parse_uint64(data, length, &value->u64) && value->u64 <= UINT32_MAX;
+  case CSV_TYPE_UINT64:
+    return csv_parse_uint64(data, length, &value->u64);
+
+  case CSV_TYPE_FLOAT:
+    return csv_parse_float_with_allocator(allocator, data, length, &value->f32);
+  case CSV_TYPE_DOUBLE:
+    return csv_parse_double_with_allocator(allocator, data, length, &value->f64);
+  case CSV_TYPE_BOOL:
+    return csv_parse_bool(data, length, &value->b);
+  }
+
+  return false;
+}
+
+static bool csv_table_column_skipped(const csv_table *table, size_t index) {
+  return table->columns_projected != NULL && index < table->columns_count && !table->columns_projected[index];
+}
+
+static csv_batch *csv_batch_create(const csv_allocator *allocator, size_t index, size_t columns_count, size_t size) {
+  size_t offsets_size = sizeof(size_t) * (size + 1), validity_size = (size + 7) / 8;
+  csv_batch *batch = csv_alloc(
+    allocator,
+    sizeof(csv_batch) + (sizeof(struct csv_batch_column) + offsets_size + validity_size) * columns_count
+  );
+
+  batch->allocator = *allocator;
+  batch->next = NULL;
+  batch->index = index;
+  batch->rows_count = 0;
+  batch->columns_count = columns_count;
+
+  char *arrays = (char *) (batch->columns + columns_count);
+  for (size_t i = 0; i < columns_count; ++i) {
+    struct csv_batch_column *column = &batch->columns[i];
+
+    column->data = NULL;
+    column->length = column->capacity = 0;
+    column->offsets = (size_t *) arrays;
+    column->offsets[0] = 0;
+    arrays += offsets_size;
+  }
+  for (size_t i = 0; i < columns_count; ++i) {
+    batch->columns[i].validity = (uint8_t *) arrays;
+    memset(arrays, 0, validity_size);
+    arrays += validity_size;
+  }
+
+  return batch;
+}
+
+static void csv_batch_column_put(
+  const csv_allocator *allocator,
+  struct csv_batch_column *column,
+  const char *data,
+  size_t length
+) {
+  size_t required = column->length + length;
+  if (required > column->capacity) {
+    size_t capacity = column->capacity == 0 ? LIBCSV_INITIAL_TMPSTR_BUFFER : column->capacity;
+    while (capacity < required) {
+      capacity *= 2;
+    }
+
+    column->data = csv_realloc(allocator, column->data, capacity);
+    column->capacity = capacity;
+  }
+
+  memcpy(column->data + column->length, data, length);
+  column->length = required;
+}
+
+/* Batch, which is being filled */
+static csv_batch *csv_table_batch(csv_table *table) {
+  if (table->batch == NULL) {
+    table->batch = csv_batch_create(&table->allocator, table->rows_counter, table->columns_count, table->batch_size);
+  }
+
+  return table->batch;
+}
+
+static void csv_table_queue_batch(csv_table *table) {
+  csv_batch *batch = table->batch;
+  table->batch = NULL;
+
+#ifdef LIBCSV_STATS
+  for (size_t i = batch->columns_count; i --> 0; ) {
+    table->stats.bytes_allocated += batch->columns[i].capacity;
+  }
+#endif
+
+  if (table->batches_end == NULL) {
+    table->batches_begin = batch;
+  } else {
+    table->batches_end->next = batch;
+  }
+  table->batches_end = batch;
+}
+
+/* Ends value of the current column, which is already put into the batch */
+static void csv_table_batch_flush_value(csv_table *table, bool trim) {
+  csv_batch *batch = csv_table_batch(table);
+  struct csv_batch_column *column = &batch->columns[table->state_row_column];
+  size_t row = batch->rows_count;
+
+  if (!table->state_skip) {
+    if (trim) {
+      while (
+        column->length != column->offsets[row] &&
+        (column->data[column->length - 1] == ' ' || column->data[column->length - 1] == '\t')
+      ) {
+        --column->length;
+      }
+    }
+
+    column->validity[row / 8] |= (uint8_t) (1 << (row % 8));
+  }
+
+  column->offsets[row + 1] = column->length;
+}
+
+static void csv_table_batch_flush_row(csv_table *table) {
+  csv_batch *batch = csv_table_batch(table);
+  size_t row = batch->rows_count;
+
+  for (size_t i = table->state_row_column; i < table->columns_count; ++i) {
+    batch->columns[i].offsets[row + 1] = batch->columns[i].offsets[row];
+  }
+
+  ++batch->rows_count;
+  ++table->rows_counter;
+
+  table->state_row_column = 0;
+  table->state_skip = csv_table_column_skipped(table, 0);
+  table->state_cs_len = 0;
+
+  if (batch->rows_count == table->batch_size) {
+    csv_table_queue_batch(table);
+  }
+}
+
+/* Appends characters of input to the current column, avoiding copy while they are contiguous in retained chunk */
+static void csv_table_state_put(csv_table *table, const char *data, size_t length) {
+  if (table->state_skip) {
+    return;
+  }
+
+  if (table->batch_size != 0 && table->has_header && table->state_row_column < table->columns_count) {
+    csv_batch_column_put(&table->allocator, &csv_table_batch(table)->columns[table->state_row_column], data, length);
+    return;
+  }
+
+  if (table->state_view_begin != NULL) {
+    if (table->state_view_end == data) {
+      table->state_view_end += length;
+      return;
+    }
+
+    csv_table_state_view_materialize(table);
+  } else if (table->state_chunk != NULL && table->state_cs_len == table->state_cs_field) {
+    table->state_view_begin = data;
+    table->state_view_end = data + length;
+    return;
+  }
+
+  csv_table_state_cs_put_length(table, data, length);
+}
+
+/* Marks value of column, which is not projected, in state_values */
+static const char csv_value_skipped[1];
+
+static void csv_table_add_column(csv_table *table, const char *name, size_t length) {
+  char *str = csv_alloc(&table->allocator, length + 1);
+  memcpy(str, name, length);
+  str[length] = '\0';
+
+  table->columns = csv_realloc(&table->allocator, table->columns, (table->columns_count + 1) * sizeof(csv_column));
+  csv_column *col = &table->columns[table->columns_count];
+
+  col->table = table;
+  col->index = table->columns_count;
+  col->name = str;
+
+  ++table->columns_count;
+}
+
+static void csv_table_state_cs_flush(csv_table *table, bool escaped) {
+  bool trim = !escaped && table->dialect.trim;
+  size_t field = table->state_cs_field;
+  const char *state_cs = table->state_cs + field;
+  size_t len = table->state_cs_len - field;
+  struct csv_chunk *chunk = NULL;
+
+  if (table->state_view_begin != NULL) {
+    state_cs = table->state_view_begin;
+    len = table->state_view_end - table->state_view_begin;
+    chunk = table->state_chunk;
+    table->state_view_begin = table->state_view_end = NULL;
+  }
+
+  size_t old_len = len;
+
+  if (len != 0 && trim) {
+    for (; len --> 0; ) {
+      if (state_cs[len] != ' ' && state_cs[len] != '\t') {
+        break;
+      }
+    }
+    ++len;
+  }
+
+  if (!table->has_header) {
+    csv_table_add_column(table, state_cs, len);
+    table->state_cs_len = 0;
+    return;
+  }
+
+  if (table->state_row_column >= table->columns_count) {
+    if (table->error_callback != NULL) {
+      (table->error_callback)(
+        "Unexpected extra column",
+        table->state_line,
+        table->state_column - old_len,
+        table->error_callback_data
+      );
+    }
+    table->state_cs_len = field;
+    return;
+  }
+
+  LIBCSV_STAT_ADD(table, fields_emitted, 1);
+  LIBCSV_STAT_ADD(table, quoted_fields, escaped);
+
+  if (table->batch_size != 0) {
+    csv_table_batch_flush_value(table, trim);
+    ++table->state_row_column;
+    table->state_skip = csv_table_column_skipped(table, table->state_row_column);
+    return;
+  }
+
+  struct csv_value *value = &table->state_values[table->state_row_column];
+  csv_type type = csv_table_column_type(table, table->state_row_column);
+  value->length = len;
+  value->chunk = chunk;
+  if (table->state_skip) {
+    value->data = csv_value_skipped;
+    value->length = 0;
+    value->chunk = NULL;
+  } else if (type != CSV_TYPE_STRING) {
+    /* Only converted value is stored */
+    value->chunk = NULL;
+    value->length = 0;
+    if (len != 0) {
+      if (csv_value_convert(&table->allocator, value, type, state_cs, len)) {
+        value->length = 1;
+      } else {
+        LIBCSV_STAT_ADD(table, conversion_failures, 1);
+
+        if (table->error_callback != NULL) {
+          (table->error_callback)(
+            "Value does not match type of column",
+            table->state_line,
+            table->state_column - old_len,
+            table->error_callback_data
+          );
+        }
+      }
+    }
+    table->state_cs_len = field;
+  } else if (chunk != NULL) {
+    value->data = state_cs;
+    ++table->state_chunk_references;
+  } else {
+    /* Value stays in state_cs until the row is built */
+    value->data = NULL;
+    table->state_cs_len = field + len;
+    csv_table_state_cs_reserve(table, 1);
+    table->state_cs[table->state_cs_len] = '\0';
+    ++table->state_cs_len;
+    table->state_cs_field = table->state_cs_len;
+  }
+  ++table->state_row_column;
+  table->state_skip = csv_table_column_skipped(table, table->state_row_column);
+}
+
+static csv_row *csv_table_row_alloc(csv_table *table, size_t size) {
+  if (table->pool_count != 0) {
+    --table->pool_count;
+    csv_row *row = table->pool_rows[table->pool_count];
+    table->pool_size -= row->capacity;
+
+    if (row->capacity >= size) {
+      return row;
+    }
+
+    csv_free(&table->allocator, row);
+  }
+
+  /* Round size up, so the block fits more rows when it is recycled */
+  size = (size + LIBCSV_ROW_ALIGNMENT - 1) & ~(size_t) (LIBCSV_ROW_ALIGNMENT - 1);
+
+  csv_row *row = csv_alloc(&table->allocator, size);
+  row->capacity = size;
+
+  LIBCSV_STAT_ADD(table, bytes_allocated, size);
+  return row;
+}
+
+/* Releases values of row (on the parser thread) and keeps its memory for the next rows */
+static void csv_table_pool_row(csv_table *table, csv_row *row) {
+  for (size_t i = table->columns_count; i --> 0; ) {
+    if (row->values[i].chunk != NULL) {
+      csv_table_release_chunk(table, row->values[i].chunk);
+    }
+  }
+
+  if (table->pool_size + row->capacity > table->pool_limit) {
+    csv_free(&table->allocator, row);
+    return;
+  }
+
+  if (table->pool_count == table->pool_capacity) {
+    table->pool_capacity = table->pool_capacity == 0 ? 16 : table->pool_capacity * 2;
+    table->pool_rows = csv_realloc(&table->allocator, table->pool_rows, sizeof(csv_row *) * table->pool_capacity);
+  }
+
+  table->pool_rows[table->pool_count] = row;
+  ++table->pool_count;
+  table->pool_size += row->capacity;
+}
+
+/* Builds row from state_values and state_cs in a single allocation: struct, values and then their characters */
+static csv_row *csv_table_state_build_row(csv_table *table) {
+  size_t values_size = sizeof(struct csv_value) * table->columns_count;
+  csv_row *row = csv_table_row_alloc(table, sizeof(csv_row) + values_size + table->state_cs_len);
+  char *data = (char *) row->values + values_size;
+
+  row->table = table;
+  row->index = table->rows_counter;
+  ++table->rows_counter;
+  table->columns_types_fixed = true;
+
+  if (table->state_cs_len != 0) {
+    memcpy(data, table->state_cs, table->state_cs_len);
+  }
+
+  size_t i = 0;
+  for (size_t offset = 0; i < table->state_row_column; ++i) {
+    struct csv_value value = table->state_values[i];
+    bool string = csv_table_column_type(table, i) == CSV_TYPE_STRING;
+    if (string && value.data == csv_value_skipped) {
+      value.data = NULL;
+    } else if (string && value.chunk == NULL) {
+      value.data = data + offset;
+      offset += value.length + 1;
+    }
+    row->values[i] = value;
+  }
+  for (; i < table->columns_count; ++i) {
+    row->values[i].data = NULL;
+    row->values[i].length = 0;
+    row->values[i].chunk = NULL;
+  }
+
+  table->state_row_column = 0;
+  table->state_skip = csv_table_column_skipped(table, 0);
+  table->state_cs_len = 0;
+  table->state_cs_field = 0;
+
+  return row;
+}
+
+static void csv_table_build_columns_index(csv_table *table) {
+  size_t capacity = 4;
+  while (capacity < table->columns_count * 2) {
+    capacity <<= 1;
+  }
+
+  table->columns_index = csv_calloc(&table->allocator, capacity, sizeof(size_t));
+  table->columns_index_mask = capacity - 1;
+
+  /*
+   * Insert from the last column, so columns with the same name are met from the last one while probing, as in the
+   * linear search
+   */
+  for (size_t i = table->columns_count; i --> 0; ) {
+    size_t slot = hash_ignore_case(table->columns[i].name) & table->columns_index_mask;
+    while (table->columns_index[slot] != 0) {
+      slot = (slot + 1) & table->columns_index_mask;
+    }
+
+    table->columns_index[slot] = i + 1;
+  }
+}
+
+static void csv_table_queue_row(csv_table *table, csv_row *row) {
+  if (((table->rows_end + 1) & table->rows_capacity_mask) == table->rows_begin) {
+    size_t old_mask = table->rows_capacity_mask;
+
+    table->rows_capacity <<= 1; /* *= 2 */
+    ++table->rows_capacity_log;
+    table->rows_capacity_mask = (table->rows_capacity_mask << 1) | 1;
+
+    csv_row **new_rows = csv_alloc(&table->allocator, sizeof(csv_row *) * table->rows_capacity);
+    size_t rows_count = 0;
+    for (size_t i = 0, j = table->rows_begin; j != table->rows_end; ++i, ++j, j &= old_mask) {
+      new_rows[i] = table->rows_queue[j];
+      ++rows_count;
+    }
+
+    csv_free(&table->allocator, table->rows_queue);
+    table->rows_queue = new_rows;
+    table->rows_begin = 0;
+    table->rows_end = rows_count;
+
+    LIBCSV_STAT_ADD(table, queue_resizes, 1);
+    LIBCSV_STAT_ADD(table, bytes_allocated, sizeof(csv_row *) * table->rows_capacity);
+  }
+
+  table->rows_queue[table->rows_end] = row;
+
+  ++table->rows_end;
+  table->rows_end &= table->rows_capacity_mask;
+
+  LIBCSV_STAT_MAX(table, queue_peak, csv_table_available_rows(table));
+}
+
+static struct csv_channel_segment *csv_channel_segment_create(csv_channel *channel, size_t capacity) {
+  struct csv_channel_segment *segment = atomic_exchange_explicit(&channel->spare, NULL, memory_order_acq_rel);
+
+  if (segment != NULL && segment->capacity < capacity) {
+    csv_free(channel->allocator, segment);
+    segment = NULL;
+  }
+
+  if (segment == NULL) {
+    segment = csv_alloc(channel->allocator, sizeof(struct csv_channel_segment) + sizeof(csv_row *) * capacity);
+    segment->capacity = capacity;
+  }
+
+  atomic_init(&segment->written, 0);
+  atomic_init(&segment->next, NULL);
+  return segment;
+}
+
+static void csv_channel_wake(csv_channel *channel) {
+#ifdef LIBCSV_HAVE_PTHREAD
+  /* Pairs with the fence in csv_channel_next_row: either consumer sees the row, or producer sees it waiting */
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&channel->waiting, memory_order_relaxed)) {
+    pthread_mutex_lock(&channel->mutex);
+    pthread_cond_signal(&channel->condition);
+    pthread_mutex_unlock(&channel->mutex);
+  }
+#else
+  (void) channel;
+#endif
+}
+
+static void csv_channel_push(csv_channel *channel, csv_row *row) {
+  struct csv_channel_segment *tail = channel->tail;
+
+  if (channel->tail_written == tail->capacity) {
+    size_t capacity = tail->capacity < LIBCSV_CHANNEL_SEGMENT_MAX ? tail->capacity * 2 : tail->capacity;
+    struct csv_channel_segment *segment = csv_channel_segment_create(channel, capacity);
+
+    atomic_store_explicit(&tail->next, segment, memory_order_release);
+    channel->tail = tail = segment;
+    channel->tail_written = 0;
+  }
+
+  tail->rows[channel->tail_written] = row;
+  ++channel->tail_written;
+  atomic_store_explicit(&tail->written, channel->tail_written, memory_order_release);
+
+  csv_channel_wake(channel);
+}
+
+static void csv_table_send_row(csv_table *table, csv_row *row) {
+  if (table->state_chunk_references != 0) {
+    /* Consumer may release row at any moment, so its references are added to the chunk right away */
+    atomic_fetch_add(&table->state_chunk->references, table->state_chunk_references);
+    table->state_chunk_references = 0;
+  }
+
+  csv_channel_push(table->channel, row);
+}
+
+/* Lends row to the row callback, then it is recycled, so the next row reuses its memory */
+static void csv_table_pass_row(csv_table *table, csv_row *row) {
+  (table->row_callback)(row, table->row_callback_data);
+  csv_table_pool_row(table, row);
+}
+
+static void csv_table_end_header(csv_table *table) {
+  table->has_header = true;
+  csv_table_build_columns_index(table);
+  table->state_values = csv_alloc(&table->allocator, sizeof(struct csv_value) * table->columns_count);
+}
+
+static void csv_table_state_flush_row(csv_table *table) {
+  if (!table->has_header) {
+    if (table->columns_count == 0) {
+      return;
+    }
+
+    csv_table_end_header(table);
+  } else if (table->state_row_column != 0) {
+    LIBCSV_STAT_ADD(table, rows_emitted, 1);
+
+    if (table->rows_counter < table->rows_skip) {
+      /* Row before the one csv_table_seek_row looks for */
+      csv_table_pool_row(table, csv_table_state_build_row(table));
+    } else if (table->batch_size != 0) {
+      csv_table_batch_flush_row(table);
+    } else if (table->row_callback != NULL) {
+      csv_table_pass_row(table, csv_table_state_build_row(table));
+    } else if (table->channel != NULL) {
+      csv_table_send_row(table, csv_table_state_build_row(table));
+    } else {
+      csv_table_queue_row(table, csv_table_state_build_row(table));
+    }
+  }
+}
+
+static void csv_table_add_checkpoint(csv_table *table, size_t offset) {
+  if (!table->has_header) {
+    return;
+  }
+
+  if (table->rows_counter / table->index_interval == table->index_count) {
+    if (table->index_count == table->index_capacity) {
+      table->index_capacity = table->index_capacity == 0 ? 64 : table->index_capacity * 2;
+
+      if (table->index_file != NULL) {
+        /* Index loaded from sidecar is copied once it grows */
+        struct csv_checkpoint *index = csv_alloc(
+          &table->allocator,
+          sizeof(struct csv_checkpoint) * table->index_capacity
+        );
+        memcpy(index, table->index, sizeof(struct csv_checkpoint) * table->index_count);
+        csv_chunk_release(table->index_file);
+        table->index_file = NULL;
+        table->index = index;
+      } else {
+        table->index = csv_realloc(
+          &table->allocator,
+          table->index,
+          sizeof(struct csv_checkpoint) * table->index_capacity
+        );
+      }
+    }
+
+    table->index[table->index_count].offset = offset;
+    table->index[table->index_count].line = table->state_line;
+    ++table->index_count;
+  }
+
+  table->index_next += table->index_interval;
+}
+
+/* Records checkpoint of the next row, if it is due, once row ends with newline at offset cp - data */
+static void csv_table_state_index_row(csv_table *table, const char *data, const char *cp) {
+  if (table->rows_counter == table->index_next) {
+    csv_table_add_checkpoint(table, table->state_offset + (cp - data));
+  }
+}
+
+static bool csv_table_queue_full(const csv_table *table) {
+  return table->rows_max != 0 && csv_table_available_rows(table) >= table->rows_max;
+}
+
+/*
+ * Tokenizer of the given dialect. It is inlined into csv_table_parse with constant dialect, so comparisons with its
+ * characters are compiled as immediates and the checks of disabled rules are dropped.
+ */
+static LIBCSV_ALWAYS_INLINE size_t csv_table_parse_dialect(
+  csv_table *table,
+  const char *data,
+  size_t length,
+  bool bounded,
+  const csv_dialect dialect
+) {
+  const char separator = dialect.separator, quote = dialect.quote;
+  const bool trim = dialect.trim, cr_newline = dialect.cr_newline;
+  const char *begin = data, *end = data + length;
+  enum csv_table_state state = table->state;
+  bool stop = false;
+  struct csv_scanner scanner = {
+    .scan_block = table->scan_block,
+    .separator = separator,
+    .quote = quote,
+    .base = NULL,
+  };
+
+  while (begin < end) {
+    if (state == TABLE_STATE_COLUMN_IN || state == TABLE_STATE_COLUMN_IN_ESCAPE) {
+      /* Skip straight to the next structural character, there is no newline before it */
+      const char *next = csv_scanner_next(&scanner, begin, end, state == TABLE_STATE_COLUMN_IN_ESCAPE);
+      if (next != begin) {
+        csv_table_state_put(table, begin, next - begin);
+        table->state_column += next - begin;
+        begin = next;
+
+        if (begin == end) {
+          break;
+        }
+      }
+    }
+
+    const char *cp = begin;
+    char c = *begin;
+
+    switch (state) {
+    case TABLE_STATE_NEWLINE:
+      if (c != '\n' && !(cr_newline && c == '\r')) {
+        state = TABLE_STATE_COLUMN_BEGIN;
+        --begin;
+      }
+      break;
+
+    case TABLE_STATE_COLUMN_BEGIN:
+      if (c == '\n' || (cr_newline && c == '\r')) {
+        csv_table_state_cs_flush(table, false);
         csv_table_state_flush_row(table);
+        csv_table_state_index_row(table, data, cp);
         state = TABLE_STATE_NEWLINE;
-      } else if (c == table->separator) {
-        csv_table_state_cs_flush(table, true);
-      } else if (c == '"') {
+        stop = bounded && csv_table_queue_full(table);
+      } else if (c == separator) {
+        csv_table_state_cs_flush(table, false);
+      } else if (trim && (c == ' ' || c == '\t')) {
+        /* Skip whitespace */
+      } else if (c == quote) {
         state = TABLE_STATE_COLUMN_IN_ESCAPE;
       } else {
-        csv_table_state_cs_put(table, c);
+        csv_table_state_put(table, begin, 1);
         state = TABLE_STATE_COLUMN_IN;
       }
-      break;
+      break;
+
+    case TABLE_STATE_COLUMN_IN:
+      if (c == '\n' || (cr_newline && c == '\r')) {
+        csv_table_state_cs_flush(table, false);
+        csv_table_state_flush_row(table);
+        csv_table_state_index_row(table, data, cp);
+        state = TABLE_STATE_NEWLINE;
+        stop = bounded && csv_table_queue_full(table);
+        --begin;
+      } else if (c == separator) {
+        csv_table_state_cs_flush(table, false);
+        state = TABLE_STATE_COLUMN_BEGIN;
+      } else {
+        csv_table_state_put(table, begin, 1);
+      }
+      break;
+
+    case TABLE_STATE_COLUMN_IN_ESCAPE:
+      if (c == quote) {
+        state = TABLE_STATE_COLUMN_IN_ESCAPE_ESCAPE;
+      } else {
+        csv_table_state_put(table, begin, 1);
+      }
+      break;
+
+    case TABLE_STATE_COLUMN_IN_ESCAPE_ESCAPE:
+      if (c == quote) {
+        csv_table_state_put(table, begin, 1);
+        state = TABLE_STATE_COLUMN_IN_ESCAPE;
+      } else {
+        state = TABLE_STATE_COLUMN_IN_ESCAPE_END;
+        --begin;
+      }
+      break;
+
+    case TABLE_STATE_COLUMN_IN_ESCAPE_END:
+      if (c == '\n' || (cr_newline && c == '\r')) {
+        csv_table_state_cs_flush(table, true);
+        csv_table_state_flush_row(table);
+        csv_table_state_index_row(table, data, cp);
+        state = TABLE_STATE_NEWLINE;
+        stop = bounded && csv_table_queue_full(table);
+        --begin;
+      } else if (c == separator) {
+        csv_table_state_cs_flush(table, true);
+        state = TABLE_STATE_COLUMN_BEGIN;
+      } else if (trim && (c == ' ' || c == '\t')) {
+        /* Skip whitespace */
+      } else {
+        if (table->error_callback != NULL) {
+          (table->error_callback)(
+            "Unexpected symbol after end of escaped string",
+            table->state_line, table->state_column, table->error_callback_data
+          );
+        }
+      }
+      break;
+    }
+
+    if (cp == begin) {
+      if (c == '\n') {
+        ++table->state_line;
+        table->state_column = 0;
+      } else {
+        ++table->state_column;
+      }
+    }
+    ++begin;
+
+    if (stop) {
+      break;
+    }
+  }
+
+  table->state = state;
+  table->state_offset += begin - data;
+  LIBCSV_STAT_ADD(table, bytes_consumed, begin - data);
+
+  if (table->state_view_begin != NULL) {
+    /* Column continues in the next chunk, so it can not reference this one */
+    csv_table_state_view_materialize(table);
+  }
+
+  return begin - data;
+}
+
+/* Returns number of parsed characters, which is less than length if bounded and queue gets full */
+static size_t csv_table_parse(csv_table *table, const char *data, size_t length, bool bounded) {
+  const csv_dialect *dialect = &table->dialect;
+
+  /*
+   * The default dialect gets its own tokenizer. More of them do not pay off: the hot loop is already in the scanner,
+   * and the inlined copies crowd helpers out of being inlined.
+   */
+  if (dialect->separator == ',' && dialect->quote == '"' && dialect->trim && dialect->cr_newline) {
+    return csv_table_parse_dialect(table, data, length, bounded, (csv_dialect) {',', '"', true, true});
+  }
+
+  return csv_table_parse_dialect(table, data, length, bounded, *dialect);
+}
+
+/* Error reported by worker, replayed by the table once the range of worker is accepted */
+struct csv_worker_error {
+  const char *error;
+  size_t line, column;
+};
+
+/* Parses range of input, which is assumed to start at the beginning of a row, into a separate table */
+struct csv_worker {
+  const csv_allocator *allocator; /* of the parent table */
+  csv_table *table;
+  const char *begin, *end;
+  char quote;
+  size_t quotes;
+
+  size_t errors_count;
+  size_t errors_capacity;
+  struct csv_worker_error *errors;
+
+#ifdef LIBCSV_HAVE_PTHREAD
+  pthread_t thread;
+  bool started;
+#endif
+};
+
+static void csv_worker_error_callback(const char *error, size_t line, size_t column, void *data) {
+  struct csv_worker *worker = data;
+
+  if (worker->errors_count == worker->errors_capacity) {
+    worker->errors_capacity = worker->errors_capacity == 0 ? 4 : worker->errors_capacity * 2;
+    worker->errors = csv_realloc(
+      worker->allocator,
+      worker->errors,
+      sizeof(struct csv_worker_error) * worker->errors_capacity
+    );
+  }
+
+  struct csv_worker_error *record = &worker->errors[worker->errors_count];
+  record->error = error;
+  record->line = line;
+  record->column = column;
+  ++worker->errors_count;
+}
+
+static void *csv_worker_count_quotes(void *data) {
+  struct csv_worker *worker = data;
+  size_t quotes = 0;
+
+  for (const char *it = worker->begin; it != worker->end; ++it) {
+    quotes += *it == worker->quote;
+  }
+
+  worker->quotes = quotes;
+  return NULL;
+}
+
+static void *csv_worker_parse(void *data) {
+  struct csv_worker *worker = data;
+
+  csv_table_parse(worker->table, worker->begin, worker->end - worker->begin, false);
+  return NULL;
+}
+
+/* Runs function for each worker, the first one in the calling thread */
+static void csv_workers_run(struct csv_worker *workers, size_t count, void *(*function)(void *)) {
+#ifdef LIBCSV_HAVE_PTHREAD
+  for (size_t i = 1; i < count; ++i) {
+    workers[i].started = pthread_create(&workers[i].thread, NULL, function, &workers[i]) == 0;
+  }
+#endif
+
+  function(&workers[0]);
+
+  for (size_t i = 1; i < count; ++i) {
+#ifdef LIBCSV_HAVE_PTHREAD
+    if (workers[i].started) {
+      pthread_join(workers[i].thread, NULL);
+      continue;
+    }
+#endif
+
+    function(&workers[i]);
+  }
+}
+
+/* Creates table which parses rows the same way as the given one, whose header is already parsed */
+static csv_table *csv_table_create_worker(const csv_table *table, struct csv_worker *worker) {
+  csv_table *result = csv_table_create_with_allocator(&table->allocator);
+
+  csv_table_set_error_callback(result, csv_worker_error_callback, worker);
+  result->dialect = table->dialect;
+  result->scan_block = table->scan_block;
+  result->state_chunk = table->state_chunk;
+
+  /* Columns are borrowed, the worker does not need their names */
+  result->has_header = true;
+  result->columns_count = table->columns_count;
+  result->columns = table->columns;
+  result->columns_projected = table->columns_projected;
+  result->columns_types = table->columns_types;
+  result->state_skip = csv_table_column_skipped(table, 0);
+  result->state_values = csv_alloc(&table->allocator, sizeof(struct csv_value) * table->columns_count);
+
+  return result;
+}
+
+/* Moves rows of worker to the table, renumbering them, and reports its errors relative to the current line */
+static void csv_table_merge_worker(csv_table *table, struct csv_worker *worker) {
+  csv_table *source = worker->table;
+
+  for (size_t i = 0; i < worker->errors_count; ++i) {
+    if (table->error_callback != NULL) {
+      (table->error_callback)(
+        worker->errors[i].error,
+        table->state_line + worker->errors[i].line - 1,
+        worker->errors[i].column,
+        table->error_callback_data
+      );
+    }
+  }
+
+  table->state_chunk_references += source->state_chunk_references;
+  source->state_chunk_references = 0;
+
+  csv_row *row;
+  while ((row = csv_table_next_row(source)) != NULL) {
+    row->table = table;
+    row->index = table->rows_counter;
+    ++table->rows_counter;
+    table->columns_types_fixed = true;
+
+    if (table->row_callback != NULL) {
+      csv_table_pass_row(table, row);
+    } else if (table->channel != NULL) {
+      csv_table_send_row(table, row);
+    } else {
+      csv_table_queue_row(table, row);
+    }
+  }
+
+  table->state_line += source->state_line - 1;
+
+#ifdef LIBCSV_STATS
+  table->stats.bytes_consumed += source->stats.bytes_consumed;
+  table->stats.rows_emitted += source->stats.rows_emitted;
+  table->stats.fields_emitted += source->stats.fields_emitted;
+  table->stats.quoted_fields += source->stats.quoted_fields;
+  table->stats.buffer_regrowths += source->stats.buffer_regrowths;
+  table->stats.bytes_allocated += source->stats.bytes_allocated;
+  table->stats.conversion_failures += source->stats.conversion_failures;
+#endif
+}
+
+static void csv_worker_free(csv_table *table, struct csv_worker *worker) {
+  /* Rows of rejected worker are recycled while it still has columns, so they release their references */
+  csv_row *row;
+  while ((row = csv_table_next_row(worker->table)) != NULL) {
+    csv_table_recycle_row(worker->table, row);
+  }
+
+  if (table->state_chunk != NULL) {
+    /* The row being parsed is freed, so the references it releases must be counted */
+    atomic_fetch_add(&table->state_chunk->references, worker->table->state_chunk_references);
+  }
+
+  worker->table->columns_count = 0;
+  worker->table->columns = NULL;
+  worker->table->columns_projected = NULL;
+  worker->table->columns_types = NULL;
+  csv_table_free(worker->table);
+  csv_free(&table->allocator, worker->errors);
+}
+
+/*
+ * Splits input at newlines into ranges, which are parsed by workers at the same time. Quotes are counted in a quick
+ * pass first, so ranges do not start inside of escaped columns. Quotes inside of unescaped columns may still mislead
+ * it, so a range is accepted only if the previous one ends at the beginning of a row. Otherwise rows are parsed by the
+ * table itself from the first rejected range.
+ */
+static void csv_table_add_data_parallel(csv_table *table, const char *data, size_t length) {
+  const char *begin = data, *end = data + length;
+
+  /* Workers start at the beginning of a row, once columns are known */
+  while (!table->has_header || table->state != TABLE_STATE_NEWLINE) {
+    if (begin == end) {
+      return;
+    }
+
+    const char *newline = memchr(begin, '\n', end - begin);
+    const char *next = newline == NULL ? end : newline + 1;
+
+    csv_table_parse(table, begin, next - begin, false);
+    begin = next;
+  }
+
+  /* The last line may continue in the next data, so it is left to the table */
+  const char *ranges_end = end;
+  while (ranges_end != begin && ranges_end[-1] != '\n') {
+    --ranges_end;
+  }
+
+  size_t ranges_length = ranges_end - begin;
+  size_t count = table->thread_count;
+  if (count > ranges_length / LIBCSV_PARALLEL_MIN_LENGTH) {
+    count = ranges_length / LIBCSV_PARALLEL_MIN_LENGTH;
+  }
+
+  if (count < 2) {
+    csv_table_parse(table, begin, end - begin, false);
+    return;
+  }
+
+  struct csv_worker *workers = csv_calloc(&table->allocator, count, sizeof(struct csv_worker));
+  for (size_t i = 0; i < count; ++i) {
+    workers[i].allocator = &table->allocator;
+    workers[i].begin = begin + ranges_length / count * i;
+    workers[i].end = i + 1 == count ? ranges_end : begin + ranges_length / count * (i + 1);
+    workers[i].quote = table->dialect.quote;
+  }
+  csv_workers_run(workers, count, csv_worker_count_quotes);
+
+  /* Ranges end at the first newline preceded by an even number of quotes, counting from the start of ranges */
+  const char *range_begin = begin, *cursor = begin;
+  size_t quotes = 0;
+  bool escaped = false;
+  for (size_t i = 0; i < count; ++i) {
+    const char *range_end = ranges_end;
+
+    if (i + 1 != count) {
+      quotes += workers[i].quotes;
+      if (cursor <= workers[i].end) {
+        cursor = workers[i].end;
+        escaped = quotes % 2 != 0;
+      }
+
+      while (cursor != ranges_end) {
+        char c = *cursor;
+        ++cursor;
+
+        if (c == table->dialect.quote) {
+          escaped = !escaped;
+        } else if (c == '\n' && !escaped) {
+          break;
+        }
+      }
+      range_end = cursor;
+    }
+
+    workers[i].begin = range_begin;
+    workers[i].end = range_end;
+    workers[i].table = csv_table_create_worker(table, &workers[i]);
+    range_begin = range_end;
+  }
+  csv_workers_run(workers, count, csv_worker_parse);
+
+  size_t accepted = 0;
+  while (accepted < count && workers[accepted].table->state == TABLE_STATE_NEWLINE) {
+    csv_table_merge_worker(table, &workers[accepted]);
+    ++accepted;
+  }
+
+  const char *rest = accepted < count ? workers[accepted].begin : ranges_end;
+
+  for (size_t i = count; i --> 0; ) {
+    csv_worker_free(table, &workers[i]);
+  }
+  csv_free(&table->allocator, workers);
+
+  csv_table_parse(table, rest, end - rest, false);
+}
+
+void csv_table_add_data_length(csv_table *table, const char *data, size_t length) {
+  if (
+    table->thread_count > 1 && table->batch_size == 0 && table->index_interval == 0 &&
+    length >= LIBCSV_PARALLEL_MIN_LENGTH * 2
+  ) {
+    csv_table_add_data_parallel(table, data, length);
+  } else {
+    csv_table_parse(table, data, length, false);
+  }
+}
+
+size_t csv_table_feed(csv_table *table, const char *data, size_t length) {
+  if (csv_table_queue_full(table)) {
+    return 0;
+  }
+
+  return csv_table_parse(table, data, length, true);
+}
+
+/* Creates chunk of data, which is kept by the table for csv_table_seek_row if there is index */
+static struct csv_chunk *csv_table_retain(
+  csv_table *table,
+  const char *data,
+  size_t length,
+  csv_release_callback release,
+  void *release_data
+) {
+  struct csv_chunk *chunk = csv_chunk_create(&table->allocator, data, length, release, release_data);
+  LIBCSV_STAT_ADD(table, bytes_allocated, sizeof(struct csv_chunk));
+
+  if (table->index_interval != 0) {
+    if (table->index_source != NULL) {
+      csv_chunk_release(table->index_source);
+    }
+
+    atomic_fetch_add(&chunk->references, 1);
+    table->index_source = chunk;
+    table->index_source_offset = table->state_offset;
+    table->index_source_position = length;
+  }
+
+  return chunk;
+}
+
+void csv_table_add_data_retained(
+  csv_table *table,
+  const char *data,
+  size_t length,
+  csv_release_callback release,
+  void *release_data
+) {
+  struct csv_chunk *chunk = csv_table_retain(table, data, length, release, release_data);
+
+  table->state_chunk = chunk;
+  csv_table_add_data_length(table, data, length);
+  table->state_chunk = NULL;
+
+  atomic_fetch_add(&chunk->references, table->state_chunk_references);
+  table->state_chunk_references = 0;
+
+  if (table->index_interval != 0) {
+    table->index_rows = table->rows_counter;
+  }
+
+  csv_chunk_release(chunk);
+}
+
+
+/* Index */
+size_t csv_table_get_index_interval(const csv_table *table) {
+  return table->index_interval;
+}
+
+bool csv_table_set_index_interval(csv_table *table, size_t interval) {
+  if (table->state_offset != 0) {
+    return false;
+  }
+
+  table->index_interval = interval;
+  table->index_next = interval == 0 ? SIZE_MAX : 0;
+  return true;
+}
+
+size_t csv_table_index_size(const csv_table *table) {
+  return table->index_count;
+}
+
+size_t csv_table_index_rows(const csv_table *table) {
+  return table->index_rows;
+}
+
+/* Drops the row being parsed, so the next data is parsed from the beginning of a row */
+static void csv_table_drop_row(csv_table *table) {
+  for (size_t i = table->state_row_column; i --> 0; ) {
+    if (table->state_values[i].chunk != NULL) {
+      csv_chunk_release(table->state_values[i].chunk);
+    }
+  }
+  table->state_row_column = 0;
+  table->state_skip = csv_table_column_skipped(table, 0);
+  table->state_cs_len = 0;
+  table->state_cs_field = 0;
+  table->state_view_begin = table->state_view_end = NULL;
+  table->state = TABLE_STATE_NEWLINE;
+}
+
+/* Drops queued rows and the row being parsed, so parsing continues from checkpoint, skipping rows before n */
+static void csv_table_restore_checkpoint(csv_table *table, size_t checkpoint, size_t n) {
+  const struct csv_checkpoint *record = &table->index[checkpoint];
+
+  csv_row *row;
+  while ((row = csv_table_next_row(table)) != NULL) {
+    csv_table_recycle_row(table, row);
+  }
+
+  csv_table_drop_row(table);
+  table->state_line = record->line;
+  table->state_column = 0;
+  table->state_offset = record->offset;
+  table->rows_counter = checkpoint * table->index_interval;
+  table->rows_skip = n;
+  table->index_next = table->rows_counter + table->index_interval;
+  table->index_source_position = record->offset - table->index_source_offset;
+}
+
+bool csv_table_seek_row(csv_table *table, size_t n) {
+  struct csv_chunk *source = table->index_source;
+  if (source == NULL || table->index_count == 0 || table->batch_size != 0) {
+    return false;
+  }
+
+  size_t checkpoint = n / table->index_interval;
+  if (checkpoint >= table->index_count) {
+    checkpoint = table->index_count - 1;
+  }
+
+  /* Rows recorded after the retained data are searched from its last one */
+  size_t source_end = table->index_source_offset + source->length;
+  while (checkpoint != 0 && table->index[checkpoint].offset >= source_end) {
+    --checkpoint;
+  }
+
+  const struct csv_checkpoint *record = &table->index[checkpoint];
+  if (record->offset < table->index_source_offset || record->offset >= source_end) {
+    return false;
+  }
+
+  csv_table_restore_checkpoint(table, checkpoint, n);
+  csv_table_resume(table);
+  return true;
+}
+
+size_t csv_table_resume(csv_table *table) {
+  struct csv_chunk *source = table->index_source;
+  if (source == NULL || table->index_source_position == source->length || csv_table_queue_full(table)) {
+    return 0;
+  }
+
+  table->state_chunk = source;
+  size_t parsed = csv_table_parse(
+    table,
+    source->data + table->index_source_position,
+    source->length - table->index_source_position,
+    true
+  );
+  table->state_chunk = NULL;
+
+  atomic_fetch_add(&source->references, table->state_chunk_references);
+  table->state_chunk_references = 0;
+
+  table->index_source_position += parsed;
+  return parsed;
+}
+
+
+/* Files */
+
+/* Maps whole file into memory (or reads it by allocator, if mmap is not available) */
+static bool csv_file_load(const csv_allocator *allocator, const char *path, const char **data, size_t *length) {
+#ifdef LIBCSV_HAVE_MMAP
+  (void) allocator;
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (uint64_t) st.st_size > SIZE_MAX) {
+    close(fd);
+    return false;
+  }
+
+  *length = (size_t) st.st_size;
+  if (*length == 0) {
+    close(fd);
+    *data = NULL;
+    return true;
+  }
+
+  void *map = mmap(NULL, *length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return false;
+  }
+
+#ifdef MADV_SEQUENTIAL
+  madvise(map, *length, MADV_SEQUENTIAL);
+#endif
+
+  *data = map;
+  return true;
+#else
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+
+  size_t size = 0, capacity = 1 << 16;
+  char *buffer = csv_alloc(allocator, capacity);
+  for (size_t read; (read = fread(buffer + size, 1, capacity - size, file)) != 0; ) {
+    size += read;
+    if (size == capacity) {
+      capacity *= 2;
+      buffer = csv_realloc(allocator, buffer, capacity);
+    }
+  }
+
+  bool ok = !ferror(file);
+  fclose(file);
+  if (!ok) {
+    csv_free(allocator, buffer);
+    return false;
+  }
+
+  *data = buffer;
+  *length = size;
+  return true;
+#endif
+}
+
+/* release_data is allocator, which has loaded the file */
+static void csv_file_unload(const char *data, size_t length, void *release_data) {
+  if (data == NULL) {
+    return;
+  }
+
+#ifdef LIBCSV_HAVE_MMAP
+  (void) release_data;
+  munmap((void *) data, length);
+#else
+  (void) length;
+  csv_free(release_data, (char *) data);
+#endif
+}
+
+bool csv_table_open_file(csv_table *table, const char *path) {
+  const char *data;
+  size_t length;
+  if (!csv_file_load(&table->allocator, path, &data, &length)) {
+    return false;
+  }
+
+  csv_table_add_data_length(table, data, length);
+  csv_file_unload(data, length, &table->allocator);
+  return true;
+}
+
+bool csv_table_map_file(csv_table *table, const char *path) {
+  const char *data;
+  size_t length;
+  if (!csv_file_load(&table->allocator, path, &data, &length)) {
+    return false;
+  }
+
+  csv_table_add_data_retained(table, data, length, csv_file_unload, &table->allocator);
+  return true;
+}
+
+/* Sidecar index file: this header, NUL-terminated names of columns padded to 8 bytes, and then checkpoints */
+struct csv_index_file {
+  char magic[8];
+  uint32_t version;
+  uint32_t byte_order; /* LIBCSV_INDEX_BYTE_ORDER, so file of another platform is rebuilt */
+  csv_dialect dialect;
+  uint64_t source_size;
+  int64_t source_mtime_sec, source_mtime_nsec;
+  uint64_t interval;
+  uint64_t rows;
+  uint64_t columns_count;
+  uint64_t names_size; /* with padding */
+  uint64_t checkpoints_count;
+};
+
+#define LIBCSV_INDEX_MAGIC "LIBCSVIX"
+#define LIBCSV_INDEX_VERSION 1
+#define LIBCSV_INDEX_BYTE_ORDER 0x01020304
+
+/* Size and modification time of source file, index is stale if they change */
+struct csv_file_fingerprint {
+  uint64_t size;
+  int64_t mtime_sec, mtime_nsec;
+};
+
+static bool csv_file_fingerprint(const char *path, struct csv_file_fingerprint *fingerprint) {
+#ifdef LIBCSV_HAVE_MMAP
+  struct stat st;
+  if (stat(path, &st) != 0) {
+    return false;
+  }
+
+  fingerprint->size = (uint64_t) st.st_size;
+  fingerprint->mtime_sec = (int64_t) st.st_mtime;
+#ifdef __APPLE__
+  fingerprint->mtime_nsec = (int64_t) st.st_mtimespec.tv_nsec;
+#else
+  fingerprint->mtime_nsec = (int64_t) st.st_mtim.tv_nsec;
+#endif
+  return true;
+#else
+  /* Without stat index can not be checked, so it is never saved */
+  (void) path;
+  (void) fingerprint;
+  return false;
+#endif
+}
+
+static bool csv_dialect_equals(csv_dialect a, csv_dialect b) {
+  return a.separator == b.separator && a.quote == b.quote && a.trim == b.trim && a.cr_newline == b.cr_newline;
+}
+
+/* Loads columns and checkpoints from sidecar, if it is valid for the source file and dialect of table */
+static bool csv_table_load_index(
+  csv_table *table,
+  const char *index_path,
+  const struct csv_file_fingerprint *fingerprint
+) {
+  const char *data;
+  size_t length;
+  if (!csv_file_load(&table->allocator, index_path, &data, &length)) {
+    return false;
+  }
+
+  const struct csv_index_file *file = (const struct csv_index_file *) data;
+  const char *names = data + sizeof(struct csv_index_file);
+  size_t size = length - sizeof(struct csv_index_file); /* of names and checkpoints */
+  bool valid =
+    length >= sizeof(struct csv_index_file) &&
+    memcmp(file->magic, LIBCSV_INDEX_MAGIC, sizeof(file->magic)) == 0 &&
+    file->version == LIBCSV_INDEX_VERSION &&
+    file->byte_order == LIBCSV_INDEX_BYTE_ORDER &&
+    csv_dialect_equals(file->dialect, table->dialect) &&
+    file->source_size == fingerprint->size &&
+    file->source_mtime_sec == fingerprint->mtime_sec &&
+    file->source_mtime_nsec == fingerprint->mtime_nsec &&
+    file->interval != 0 &&
+    (table->index_interval == 0 || file->interval == table->index_interval) &&
+    file->columns_count != 0 &&
+    file->checkpoints_count != 0 &&
+    file->names_size % 8 == 0 &&
+    file->names_size != 0 &&
+    file->names_size <= size &&
+    (size - file->names_size) / sizeof(struct csv_checkpoint) == file->checkpoints_count &&
+    (size - file->names_size) % sizeof(struct csv_checkpoint) == 0;
+
+  /* Checkpoints are within the source (the last one may be at its end), so seeking does not read outside of it */
+  const struct csv_checkpoint *checkpoints = (const struct csv_checkpoint *) (names + (valid ? file->names_size : 0));
+  valid =
+    valid &&
+    file->checkpoints_count <= file->rows / file->interval + 1 &&
+    checkpoints[0].offset <= checkpoints[file->checkpoints_count - 1].offset &&
+    checkpoints[file->checkpoints_count - 1].offset <= file->source_size;
+
+  /* Names are checked before columns are added */
+  size_t names_count = 0;
+  for (const char *it = names, *end = names + (valid ? file->names_size : 0); it != end; ++it) {
+    names_count += *it == '\0';
+  }
+  if (!valid || names_count < file->columns_count || names[file->names_size - 1] != '\0') {
+    csv_file_unload(data, length, &table->allocator);
+    return false;
+  }
+
+  const char *name = names;
+  for (size_t i = 0; i < file->columns_count; ++i) {
+    size_t name_length = strlen(name);
+    csv_table_add_column(table, name, name_length);
+    name += name_length + 1;
+  }
+  csv_table_end_header(table);
+
+  table->index_interval = file->interval;
+  table->index_file = csv_chunk_create(&table->allocator, data, length, csv_file_unload, &table->allocator);
+  table->index = (struct csv_checkpoint *) checkpoints;
+  table->index_count = table->index_capacity = file->checkpoints_count;
+  table->index_rows = file->rows;
+  return true;
+}
+
+/* Writes sidecar to a temporary file first, which replaces the old one */
+static bool csv_table_save_index(
+  const csv_table *table,
+  const char *index_path,
+  const struct csv_file_fingerprint *fingerprint
+) {
+  struct csv_index_file file;
+  memset(&file, 0, sizeof(file));
+  memcpy(file.magic, LIBCSV_INDEX_MAGIC, sizeof(file.magic));
+  file.version = LIBCSV_INDEX_VERSION;
+  file.byte_order = LIBCSV_INDEX_BYTE_ORDER;
+  file.dialect = table->dialect;
+  file.source_size = fingerprint->size;
+  file.source_mtime_sec = fingerprint->mtime_sec;
+  file.source_mtime_nsec = fingerprint->mtime_nsec;
+  file.interval = table->index_interval;
+  file.rows = table->index_rows;
+  file.columns_count = table->columns_count;
+  file.checkpoints_count = table->index_count;
+
+  for (size_t i = 0; i < table->columns_count; ++i) {
+    file.names_size += strlen(table->columns[i].name) + 1;
+  }
+  size_t padding = (8 - file.names_size % 8) % 8;
+  file.names_size += padding;
+
+  size_t path_length = strlen(index_path);
+  char *temporary_path = csv_alloc(&table->allocator, path_length + sizeof(".tmp"));
+  memcpy(temporary_path, index_path, path_length);
+  memcpy(temporary_path + path_length, ".tmp", sizeof(".tmp"));
+
+  FILE *output = fopen(temporary_path, "wb");
+  bool ok = output != NULL;
+  if (ok) {
+    static const char zeros[8];
+
+    ok = fwrite(&file, sizeof(file), 1, output) == 1;
+    for (size_t i = 0; ok && i < table->columns_count; ++i) {
+      ok = fwrite(table->columns[i].name, strlen(table->columns[i].name) + 1, 1, output) == 1;
+    }
+    ok = ok && fwrite(zeros, 1, padding, output) == padding;
+    ok = ok && fwrite(table->index, sizeof(struct csv_checkpoint), table->index_count, output) == table->index_count;
+    ok = fclose(output) == 0 && ok;
+    ok = ok && rename(temporary_path, index_path) == 0;
+
+    if (!ok) {
+      remove(temporary_path);
+    }
+  }
+
+  csv_free(&table->allocator, temporary_path);
+  return ok;
+}
+
+bool csv_table_map_file_indexed(csv_table *table, const char *path, const char *index_path) {
+  if (table->state_offset != 0 || table->has_header || table->batch_size != 0) {
+    return false;
+  }
+
+  struct csv_file_fingerprint fingerprint = {0, 0, 0};
+  bool has_fingerprint = csv_file_fingerprint(path, &fingerprint);
+
+  const char *data;
+  size_t length;
+  if (!csv_file_load(&table->allocator, path, &data, &length)) {
+    return false;
+  }
+  has_fingerprint = has_fingerprint && fingerprint.size == length;
+
+  if (has_fingerprint && csv_table_load_index(table, index_path, &fingerprint)) {
+    csv_chunk_release(csv_table_retain(table, data, length, csv_file_unload, &table->allocator));
+  } else {
+    /* Rows are only counted while index is built */
+    if (table->index_interval == 0) {
+      csv_table_set_index_interval(table, LIBCSV_DEFAULT_INDEX_INTERVAL);
+    }
+
+    table->rows_skip = SIZE_MAX;
+    csv_table_add_data_retained(table, data, length, csv_file_unload, &table->allocator);
+    table->rows_skip = 0;
+
+    if (has_fingerprint && table->index_count != 0) {
+      csv_table_save_index(table, index_path, &fingerprint);
+    }
+  }
+
+  if (table->index_count != 0) {
+    csv_table_restore_checkpoint(table, 0, 0);
+  }
+  return true;
+}
+
+
+size_t csv_table_column_count(const csv_table *table) {
+  return table->columns_count;
+}
+
+csv_column *csv_table_column(const csv_table *table, size_t index) {
+  if (index >= table->columns_count) {
+    return NULL;
+  }
+
+  return &table->columns[index];
+}
+
+static csv_column *csv_table_column_lookup(const csv_table *table, const char *name, bool ignore_case) {
+  if (table->columns_index == NULL) {
+    /* Header is not finished yet */
+    for (size_t i = table->columns_count; i --> 0; ) {
+      const char *column_name = table->columns[i].name;
+      if (ignore_case ? equals_ignore_case(column_name, name) : strcmp(column_name, name) == 0) {
+        return &table->columns[i];
+      }
+    }
+
+    return NULL;
+  }
+
+  for (
+    size_t slot = hash_ignore_case(name) & table->columns_index_mask;
+    table->columns_index[slot] != 0;
+    slot = (slot + 1) & table->columns_index_mask
+  ) {
+    csv_column *column = &table->columns[table->columns_index[slot] - 1];
+    if (ignore_case ? equals_ignore_case(column->name, name) : strcmp(column->name, name) == 0) {
+      return column;
+    }
+  }
+
+  return NULL;
+}
+
+csv_column *csv_table_column_by_name(const csv_table *table, const char *name) {
+  return csv_table_column_lookup(table, name, false);
+}
+
+csv_column *csv_table_column_by_name_ignore_case(const csv_table *table, const char *name) {
+  return csv_table_column_lookup(table, name, true);
+}
+
+/* Projection of the column, which is being parsed, is changed once it ends */
+static void csv_table_state_update_skip(csv_table *table) {
+  if (table->state == TABLE_STATE_NEWLINE || table->state == TABLE_STATE_COLUMN_BEGIN) {
+    table->state_skip = csv_table_column_skipped(table, table->state_row_column);
+  }
+}
+
+bool csv_table_project_columns(csv_table *table, const size_t *indices, size_t count) {
+  if (!table->has_header) {
+    return false;
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    if (indices[i] >= table->columns_count) {
+      return false;
+    }
+  }
+
+  if (table->columns_projected == NULL) {
+    table->columns_projected = csv_alloc(&table->allocator, sizeof(bool) * table->columns_count);
+  }
+
+  memset(table->columns_projected, 0, sizeof(bool) * table->columns_count);
+  for (size_t i = 0; i < count; ++i) {
+    table->columns_projected[indices[i]] = true;
+  }
+
+  csv_table_state_update_skip(table);
+  return true;
+}
+
+bool csv_table_project_column_names(csv_table *table, const char *const *names, size_t count) {
+  size_t *indices = csv_alloc(&table->allocator, sizeof(size_t) * (count == 0 ? 1 : count));
+
+  for (size_t i = 0; i < count; ++i) {
+    csv_column *column = csv_table_column_lookup(table, names[i], false);
+    if (column == NULL) {
+      csv_free(&table->allocator, indices);
+      return false;
+    }
+
+    indices[i] = column->index;
+  }
+
+  bool result = csv_table_project_columns(table, indices, count);
+  csv_free(&table->allocator, indices);
+  return result;
+}
+
+void csv_table_project_all_columns(csv_table *table) {
+  csv_free(&table->allocator, table->columns_projected);
+  table->columns_projected = NULL;
+  csv_table_state_update_skip(table);
+}
+
+bool csv_table_set_column_type(csv_table *table, size_t index, csv_type type) {
+  if (
+    !table->has_header || index >= table->columns_count || table->state != TABLE_STATE_NEWLINE ||
+    table->columns_types_fixed
+  ) {
+    return false;
+  }
+
+  if (table->columns_types == NULL) {
+    table->columns_types = csv_alloc(&table->allocator, sizeof(csv_type) * table->columns_count);
+    for (size_t i = table->columns_count; i --> 0; ) {
+      table->columns_types[i] = CSV_TYPE_STRING;
+    }
+  }
+
+  table->columns_types[index] = type;
+  return true;
+}
+
+
+bool csv_table_has_header(const csv_table *table) {
+  return table->has_header;
+}
+
+bool csv_table_has_row(const csv_table *table) {
+  return table->rows_begin != table->rows_end;
+}
+
+bool csv_table_get_stats(const csv_table *table, csv_stats *stats) {
+#ifdef LIBCSV_STATS
+  *stats = table->stats;
+  return true;
+#else
+  (void) table;
+  memset(stats, 0, sizeof(*stats));
+  return false;
+#endif
+}
+
+size_t csv_table_available_rows(const csv_table *table) {
+  if (table->rows_begin > table->rows_end) {
+    return table->rows_capacity - table->rows_begin + table->rows_end;
+  }
+
+  return table->rows_end - table->rows_begin;
+}
+
+void csv_table_recycle_row(csv_table *table, csv_row *row) {
+  if (row == NULL) {
+    return;
+  }
+
+  assert(row->table == table);
+
+  if (table->channel != NULL) {
+    /* Row may be freed by consumer thread, so only the chunks are touched */
+    for (size_t i = table->columns_count; i --> 0; ) {
+      if (row->values[i].chunk != NULL) {
+        csv_chunk_release(row->values[i].chunk);
+      }
+    }
+
+    csv_free(&table->allocator, row);
+    return;
+  }
+
+  csv_table_pool_row(table, row);
+}
+
+csv_row *csv_table_next_row(csv_table *table) {
+  if (table->rows_begin == table->rows_end) {
+    return NULL;
+  }
+
+  csv_row *row = table->rows_queue[table->rows_begin];
+  ++table->rows_begin;
+  table->rows_begin &= table->rows_capacity_mask;
+
+  return row;
+}
+
+void csv_table_flush_batch(csv_table *table) {
+  if (table->batch == NULL) {
+    return;
+  }
+
+  if (table->batch->rows_count == 0) {
+    csv_batch_free(table->batch);
+    table->batch = NULL;
+    return;
+  }
+
+  csv_table_queue_batch(table);
+}
+
+csv_channel *csv_table_channel(csv_table *table) {
+  if (table->channel != NULL) {
+    return table->channel;
+  }
+
+  csv_channel *channel = csv_alloc(&table->allocator, sizeof(csv_channel));
+  channel->allocator = &table->allocator;
+  atomic_init(&channel->spare, NULL);
+  channel->tail = channel->head = csv_channel_segment_create(channel, LIBCSV_CHANNEL_SEGMENT_MIN);
+  channel->tail_written = channel->head_read = 0;
+  atomic_init(&channel->closed, false);
+  atomic_init(&channel->waiting, false);
+#ifdef LIBCSV_HAVE_PTHREAD
+  pthread_mutex_init(&channel->mutex, NULL);
+  pthread_cond_init(&channel->condition, NULL);
+#endif
+
+  table->channel = channel;
+  return channel;
+}
+
+csv_batch *csv_table_next_batch(csv_table *table) {
+  csv_batch *batch = table->batches_begin;
+  if (batch == NULL) {
+    return NULL;
+  }
+
+  table->batches_begin = batch->next;
+  if (table->batches_begin == NULL) {
+    table->batches_end = NULL;
+  }
+
+  batch->next = NULL;
+  return batch;
+}
+
+
+/* Column */
+size_t csv_column_index(const csv_column *column) {
+  return column->index;
+}
+
+const char *csv_column_name(const csv_column *column) {
+  return column->name;
+}
+
+bool csv_column_projected(const csv_column *column) {
+  return !csv_table_column_skipped(column->table, column->index);
+}
+
+csv_type csv_column_type(const csv_column *column) {
+  return csv_table_column_type(column->table, column->index);
+}
+
+
+/* Channel */
+void csv_channel_close(csv_channel *channel) {
+  atomic_store_explicit(&channel->closed, true, memory_order_release);
+  csv_channel_wake(channel);
+}
+
+csv_row *csv_channel_try_next_row(csv_channel *channel) {
+  struct csv_channel_segment *head = channel->head;
+
+  if (channel->head_read == head->capacity) {
+    struct csv_channel_segment *next = atomic_load_explicit(&head->next, memory_order_acquire);
+    if (next == NULL) {
+      return NULL;
+    }
+
+    channel->head = next;
+    channel->head_read = 0;
+    csv_free(channel->allocator, atomic_exchange_explicit(&channel->spare, head, memory_order_acq_rel));
+    head = next;
+  }
+
+  if (channel->head_read == atomic_load_explicit(&head->written, memory_order_acquire)) {
+    return NULL;
+  }
+
+  csv_row *row = head->rows[channel->head_read];
+  ++channel->head_read;
+  return row;
+}
+
+csv_row *csv_channel_next_row(csv_channel *channel) {
+  for (;;) {
+    for (size_t i = 0; i < LIBCSV_CHANNEL_SPIN; ++i) {
+      csv_row *row = csv_channel_try_next_row(channel);
+      if (row != NULL) {
+        return row;
+      }
+    }
+
+    if (atomic_load_explicit(&channel->closed, memory_order_acquire)) {
+      /* Rows pushed before channel was closed are visible now */
+      return csv_channel_try_next_row(channel);
+    }
+
+#ifdef LIBCSV_HAVE_PTHREAD
+    pthread_mutex_lock(&channel->mutex);
+    atomic_store_explicit(&channel->waiting, true, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    csv_row *row = csv_channel_try_next_row(channel);
+    if (row == NULL && !atomic_load_explicit(&channel->closed, memory_order_acquire)) {
+      pthread_cond_wait(&channel->condition, &channel->mutex);
+    }
+
+    atomic_store_explicit(&channel->waiting, false, memory_order_relaxed);
+    pthread_mutex_unlock(&channel->mutex);
+
+    if (row != NULL) {
+      return row;
+    }
+#endif
+  }
+}
+
+
+/* Batch */
+void csv_batch_free(csv_batch *batch) {
+  if (batch == NULL) {
+    return;
+  }
+
+  for (size_t i = batch->columns_count; i --> 0; ) {
+    csv_free(&batch->allocator, batch->columns[i].data);
+  }
+
+  csv_allocator allocator = batch->allocator;
+  csv_free(&allocator, batch);
+}
+
+size_t csv_batch_index(const csv_batch *batch) {
+  return batch->index;
+}
+
+size_t csv_batch_row_count(const csv_batch *batch) {
+  return batch->rows_count;
+}
+
+size_t csv_batch_column_count(const csv_batch *batch) {
+  return batch->columns_count;
+}
+
+const char *csv_batch_column_data(const csv_batch *batch, size_t column) {
+  return batch->columns[column].data;
+}
+
+const size_t *csv_batch_column_offsets(const csv_batch *batch, size_t column) {
+  return batch->columns[column].offsets;
+}
+
+const uint8_t *csv_batch_column_validity(const csv_batch *batch, size_t column) {
+  return batch->columns[column].validity;
+}
+
+bool csv_batch_value_valid(const csv_batch *batch, size_t column, size_t row) {
+  return (batch->columns[column].validity[row / 8] >> (row % 8)) & 1;
+}
+
+
+/* Row */
+size_t csv_row_index(const csv_row *row) {
+  return row->index;
+}
+
+bool csv_row_empty(const csv_row *row, const csv_column *column) {
+  if (row == NULL) {
+    return true;
+  }
+
+  return row->values[column->index].length == 0;
+}
+
+
+const char *csv_row_value(const csv_row *row, const csv_column *column) {
+  assert(row->table == column->table);
+
+  if (csv_table_column_type(column->table, column->index) != CSV_TYPE_STRING) {
+    return NULL;
+  }
+
+  return row->values[column->index].data;
+}
+
+size_t csv_row_value_length(const csv_row *row, const csv_column *column) {
+  assert(row->table == column->table);
+
+  if (csv_table_column_type(column->table, column->index) != CSV_TYPE_STRING) {
+    return 0;
+  }
+
+  return row->values[column->index].length;
+}
+
+const char *csv_row_value_default(const csv_row *row, const csv_column *column, const char *def) {
+  return csv_row_value_length(row, column) == 0 ? def : csv_row_value(row, column);
+}
+
+/* Value of numeric typed column as double */
+static bool csv_row_value_number(const csv_row *row, const csv_column *column, double *result) {
+  const struct csv_value *value = &row->values[column->index];
+  if (value->length == 0) {
+    return false;
+  }
+
+  switch (csv_table_column_type(column->table, column->index)) {
+  case CSV_TYPE_INT8:
+  case CSV_TYPE_INT16:
+  case CSV_TYPE_INT32:
+  case CSV_TYPE_INT64:
+    *result = (double) value->i64;
+    return true;
+
+  case CSV_TYPE_UINT8:
+  case CSV_TYPE_UINT16:
+  case CSV_TYPE_UINT32:
+  case CSV_TYPE_UINT64:
+    *result = (double) value->u64;
+    return true;
+
+  case CSV_TYPE_FLOAT:
+    *result = value->f32;
+    return true;
+
+  case CSV_TYPE_DOUBLE:
+    *result = value->f64;
+    return true;
+
+  default:
+    return false;
+  }
+}
+
+static bool csv_row_value_bool_typed(const csv_row *row, const csv_column *column, bool *result) {
+  assert(row->table == column->table);
+
+  const struct csv_value *value = &row->values[column->index];
+  switch (csv_table_column_type(column->table, column->index)) {
+  case CSV_TYPE_STRING:
+    return csv_parse_bool(value->data, value->length, result);
+
+  case CSV_TYPE_BOOL:
+    *result = value->b;
+    return value->length != 0;
+
+  default:
+    return false;
+  }
+}
+
+bool csv_row_value_int8(const csv_row *row, const csv_column *column, int8_t *result) {
+  int64_t value;
+  if (!csv_row_value_int64(row, column, &value) || value < INT8_MIN || value > INT8_MAX) {
+    return false;
+  }
+
+  *result = (int8_t) value;
+  return true;
+}
+
+int8_t csv_row_value_int8_default(const csv_row *row, const csv_column *column, int8_t def) {
+  int8_t result;
+  return csv_row_value_int8(row, column, &result) ? result : def;
+}
+
+
+bool csv_row_value_uint8(const csv_row *row, const csv_column *column, uint8_t *result) {
+  uint64_t value;
+  if (!csv_row_value_uint64(row, column, &value) || value > UINT8_MAX) {
+    return false;
+  }
+
+  *result = (uint8_t) value;
+  return true;
+}
+
+uint8_t csv_row_value_uint8_default(const csv_row *row, const csv_column *column, uint8_t def) {
+  uint8_t result;
+  return csv_row_value_uint8(row, column, &result) ? result : def;
+}
+
+
+bool csv_row_value_int16(const csv_row *row, const csv_column *column, int16_t *result) {
+  int64_t value;
+  if (!csv_row_value_int64(row, column, &value) || value < INT16_MIN || value > INT16_MAX) {
+    return false;
+  }
+
+  *result = (int16_t) value;
+  return true;
+}
+
+int16_t csv_row_value_int16_default(const csv_row *row, const csv_column *column, int16_t def) {
+  int16_t result;
+  return csv_row_value_int16(row, column, &result) ? result : def;
+}
+
+
+bool csv_row_value_uint16(const csv_row *row, const csv_column *column, uint16_t *result) {
+  uint64_t value;
+  if (!csv_row_value_uint64(row, column, &value) || value > UINT16_MAX) {
+    return false;
+  }
+
+  *result = (uint16_t) value;
+  return true;
+}
+
+uint16_t csv_row_value_uint16_default(const csv_row *row, const csv_column *column, uint16_t def) {
+  uint16_t result;
+  return csv_row_value_uint16(row, column, &result) ? result : def;
+}
+
+
+bool csv_row_value_int32(const csv_row *row, const csv_column *column, int32_t *result) {
+  int64_t value;
+  if (!csv_row_value_int64(row, column, &value) || value < INT32_MIN || value > INT32_MAX) {
+    return false;
+  }
+
+  *result = (int32_t) value;
+  return true;
+}
+
+int32_t csv_row_value_int32_default(const csv_row *row, const csv_column *column, int32_t def) {
+  int32_t result;
+  return csv_row_value_int32(row, column, &result) ? result : def;
+}
+
+
+bool csv_row_value_uint32(const csv_row *row, const csv_column *column, uint32_t *result) {
+  uint64_t value;
+  if (!csv_row_value_uint64(row, column, &value) || value > UINT32_MAX) {
+    return false;
+  }
+
+  *result = (uint32_t) value;
+  return true;
+}
+
+uint32_t csv_row_value_uint32_default(const csv_row *row, const csv_column *column, uint32_t def) {
+  uint32_t result;
+  return csv_row_value_uint32(row, column, &result) ? result : def;
+}
+
+
+bool csv_row_value_int64(const csv_row *row, const csv_column *column, int64_t *result) {
+  assert(row->table == column->table);
+
+  const struct csv_value *value = &row->values[column->index];
+  switch (csv_table_column_type(column->table, column->index)) {
+  case CSV_TYPE_STRING:
+    return csv_parse_int64(value->data, value->length, result);
+
+  case CSV_TYPE_INT8:
+  case CSV_TYPE_INT16:
+  case CSV_TYPE_INT32:
+  case CSV_TYPE_INT64:
+    *result = value->i64;
+    return value->length != 0;
+
+  case CSV_TYPE_UINT8:
+  case CSV_TYPE_UINT16:
+  case CSV_TYPE_UINT32:
+  case CSV_TYPE_UINT64:
+    *result = (int64_t) value->u64;
+    return value->length != 0 && value->u64 <= INT64_MAX;
+
+  default:
+    return false;
+  }
+}
+
+int64_t csv_row_value_int64_default(const csv_row *row, const csv_column *column, int64_t def) {
+  int64_t result;
+  return csv_row_value_int64(row, column, &result) ? result : def;
+}
+
+
+bool csv_row_value_uint64(const csv_row *row, const csv_column *column, uint64_t *result) {
+  assert(row->table == column->table);
+
+  const struct csv_value *value = &row->values[column->index];
+  switch (csv_table_column_type(column->table, column->index)) {
+  case CSV_TYPE_STRING:
+    return csv_parse_uint64(value->data, value->length, result);
+
+  case CSV_TYPE_INT8:
+  case CSV_TYPE_INT16:
+  case CSV_TYPE_INT32:
+  case CSV_TYPE_INT64:
+    *result = (uint64_t) value->i64;
+    return value->length != 0 && value->i64 >= 0;
+
+  case CSV_TYPE_UINT8:
+  case CSV_TYPE_UINT16:
+  case CSV_TYPE_UINT32:
+  case CSV_TYPE_UINT64:
+    *result = value->u64;
+    return value->length != 0;
+
+  default:
+    return false;
+  }
+}
+
+uint64_t csv_row_value_uint64_default(const csv_row *row, const csv_column *column, uint64_t def) {
+  uint64_t result;
+  return csv_row_value_uint64(row, column, &result) ? result : def;
+}
+
+
+bool csv_row_value_float(const csv_row *row, const csv_column *column, float *result) {
+  assert(row->table == column->table);
+
+  const struct csv_value *value = &row->values[column->index];
+  csv_type type = csv_table_column_type(column->table, column->index);
+  if (type == CSV_TYPE_STRING) {
+    return csv_parse_float_with_allocator(&row->table->allocator, value->data, value->length, result);
+  } else if (type == CSV_TYPE_FLOAT) {
+    *result = value->f32;
+    return value->length != 0;
+  }
+
+  double number;
+  if (!csv_row_value_number(row, column, &number)) {
+    return false;
+  }
+
+  *result = (float) number;
+  return true;
+}
+
+float csv_row_value_float_default(const csv_row *row, const csv_column *column, float def) {
+  float result;
+  return csv_row_value_float(row, column, &result) ? result : def;
+}
+
+
+bool csv_row_value_double(const csv_row *row, const csv_column *column, double *result) {
+  assert(row->table == column->table);
+
+  const struct csv_value *value = &row->values[column->index];
+  if (csv_table_column_type(column->table, column->index) == CSV_TYPE_STRING) {
+    return csv_parse_double_with_allocator(&row->table->allocator, value->data, value->length, result);
+  }
+
+  return csv_row_value_number(row, column, result);
+}
+
+double csv_row_value_double_default(const csv_row *row, const csv_column *column, double def) {
+  double result;
+  return csv_row_value_double(row, column, &result) ? result : def;
+}
+
+
+bool csv_row_value_bool(const csv_row *row, const csv_column *column) {
+  return csv_row_value_bool_default(row, column, false);
+}
+
+bool csv_row_value_bool_default(const csv_row *row, const csv_column *column, bool def) {
+  bool result;
+  return csv_row_value_bool_typed(row, column, &result) ? result : def;
+}
+
+
+void csv_row_free(csv_row *row) {
+  if (row == NULL) {
+    return;
+  }
+
+  csv_table_recycle_row(row->table, row);
+}
+
+
+/* Writer */
+struct csv_writer {
+  csv_allocator allocator;
+  csv_write_callback callback;
+  void *callback_data;
+  bool failed;
+
+  csv_dialect dialect;
+  csv_scan_block_function scan_block;
+  size_t row_columns; /* number of values written to the current row */
+  bool value_empty; /* the last value is empty */
+
+  char *buffer;
+  size_t size;
+  size_t capacity;
+};
+
+static const char csv_digit_pairs[] =
+  "00010203040506070809"
+  "10111213141516171819"
+  "20212223242526272829"
+  "30313233343536373839"
+  "40414243444546474849"
+  "50515253545556575859"
+  "60616263646566676869"
+  "70717273747576777879"
+  "80818283848586878889"
+  "90919293949596979899";
+
+/* Writes digits of value backwards, ending at end, returns pointer to the first one */
+static char *format_uint64(uint64_t value, char *end) {
+  while (value >= 100) {
+    end -= 2;
+    memcpy(end, csv_digit_pairs + (value % 100) * 2, 2);
+    value /= 100;
+  }
+
+  if (value >= 10) {
+    end -= 2;
+    memcpy(end, csv_digit_pairs + value * 2, 2);
+  } else {
+    *--end = (char) ('0' + value);
+  }
+
+  return end;
+}
+
+/* Writes mantissa with decimal point before its last exponent digits, returns length */
+static size_t format_decimal(uint64_t mantissa, unsigned exponent, char *out) {
+  char digits[24];
+  char *end = digits + sizeof(digits);
+  char *begin = format_uint64(mantissa, end);
+  size_t count = end - begin;
+
+  if (exponent == 0) {
+    memcpy(out, begin, count);
+    return count;
+  }
+
+  if (count <= exponent) {
+    /* 0.00ddd */
+    out[0] = '0';
+    out[1] = '.';
+    memset(out + 2, '0', exponent - count);
+    memcpy(out + 2 + exponent - count, begin, count);
+    return 2 + exponent;
+  }
+
+  memcpy(out, begin, count - exponent);
+  out[count - exponent] = '.';
+  memcpy(out + count - exponent + 1, end - exponent, exponent);
+  return count + 1;
+}
+
+/* Slow path, formats with snprintf using the least precision, which converts back to the same value */
+static size_t format_float_fallback(const csv_allocator *allocator, double value, bool single, char *out) {
+  const char *point = localeconv()->decimal_point;
+  size_t point_length = strlen(point);
+  int precision = single ? 6 : 15, max_precision = single ? 9 : 17;
+
+  for (;; ++precision) {
+    size_t length = snprintf(out, LIBCSV_NUMBER_BUFFER, "%.*g", precision, value);
+
+    if (point_length != 1 || point[0] != '.') {
+      char *p = strstr(out, point);
+      if (p != NULL) {
+        *p = '.';
+        memmove(p + 1, p + point_length, out + length - (p + point_length) + 1);
+        length -= point_length - 1;
+      }
+    }
+
+    if (precision == max_precision) {
+      return length;
+    }
+
+    if (single) {
+      float parsed;
+      if (csv_parse_float_with_allocator(allocator, out, length, &parsed) && parsed == (float) value) {
+        return length;
+      }
+    } else {
+      double parsed;
+      if (csv_parse_double_with_allocator(allocator, out, length, &parsed) && parsed == value) {
+        return length;
+      }
+    }
+  }
+}
+
+/* Formats finite or special value, so csv_parse_double (or csv_parse_float if single) returns it back */
+static size_t format_float(const csv_allocator *allocator, double value, bool single, char *out) {
+  if (isnan(value)) {
+    memcpy(out, "nan", 3);
+    return 3;
+  }
+
+  size_t sign = 0;
+  if (signbit(value)) {
+    out[0] = '-';
+    sign = 1;
+    value = -value;
+  }
+
+  if (isinf(value)) {
+    memcpy(out + sign, "inf", 3);
+    return sign + 3;
+  }
+
+#if FLT_EVAL_METHOD == 0
+  /*
+   * Inverse of the fast path of the parsers: if value * 10^k is an integer m, which gives value back being divided by
+   * 10^k, then m with k fractional digits is parsed to the same value.
+   */
+  if (single) {
+    float f = (float) value;
+
+    for (unsigned k = 0; k < sizeof(csv_float_powers_of_ten) / sizeof(float); ++k) {
+      float scaled = f * csv_float_powers_of_ten[k];
+      if (scaled > (float) (UINT32_C(1) << 24)) {
+        break;
+      }
+
+      uint32_t mantissa = (uint32_t) scaled;
+      if ((float) mantissa == scaled && (float) mantissa / csv_float_powers_of_ten[k] == f) {
+        return sign + format_decimal(mantissa, k, out + sign);
+      }
+    }
+  } else {
+    for (unsigned k = 0; k < sizeof(csv_double_powers_of_ten) / sizeof(double); ++k) {
+      double scaled = value * csv_double_powers_of_ten[k];
+      if (scaled > (double) (UINT64_C(1) << 53)) {
+        break;
+      }
+
+      uint64_t mantissa = (uint64_t) scaled;
+      if ((double) mantissa == scaled && (double) mantissa / csv_double_powers_of_ten[k] == value) {
+        return sign + format_decimal(mantissa, k, out + sign);
+      }
+    }
+  }
+#endif
+
+  return sign + format_float_fallback(allocator, value, single, out + sign);
+}
+
+static bool csv_writer_write_fd(const char *data, size_t length, void *fd_data) {
+#ifdef LIBCSV_HAVE_MMAP
+  int fd = (int) (intptr_t) fd_data;
+
+  while (length != 0) {
+    ssize_t written = write(fd, data, length);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+
+      return false;
+    }
+
+    data += written;
+    length -= written;
+  }
+
+  return true;
+#else
+  (void) data;
+  (void) length;
+  (void) fd_data;
+  return false;
+#endif
+}
+
+static bool csv_writer_write_file(const char *data, size_t length, void *file) {
+  return fwrite(data, 1, length, file) == length;
+}
+
+csv_writer *csv_writer_create_fd(int fd) {
+  return csv_writer_create_callback_with_allocator(csv_writer_write_fd, (void *) (intptr_t) fd, NULL);
+}
+
+csv_writer *csv_writer_create_file(FILE *file) {
+  return csv_writer_create_callback_with_allocator(csv_writer_write_file, file, NULL);
+}
+
+csv_writer *csv_writer_create_callback(csv_write_callback callback, void *data) {
+  return csv_writer_create_callback_with_allocator(callback, data, NULL);
+}
+
+csv_writer *csv_writer_create_fd_with_allocator(int fd, const csv_allocator *allocator) {
+  return csv_writer_create_callback_with_allocator(csv_writer_write_fd, (void *) (intptr_t) fd, allocator);
+}
+
+csv_writer *csv_writer_create_file_with_allocator(FILE *file, const csv_allocator *allocator) {
+  return csv_writer_create_callback_with_allocator(csv_writer_write_file, file, allocator);
+}
+
+csv_writer *csv_writer_create_callback_with_allocator(
+  csv_write_callback callback,
+  void *data,
+  const csv_allocator *allocator
+) {
+  if (allocator == NULL) {
+    allocator = &csv_default_allocator;
+  }
+
+  csv_writer *writer = csv_alloc(allocator, sizeof(csv_writer));
+  if (writer == NULL) {
+    return NULL;
+  }
+
+  writer->buffer = csv_alloc(allocator, LIBCSV_WRITER_BUFFER_SIZE);
+  if (writer->buffer == NULL) {
+    csv_free(allocator, writer);
+    return NULL;
+  }
+
+  writer->allocator = *allocator;
+  writer->callback = callback;
+  writer->callback_data = data;
+  writer->failed = false;
+
+  writer->dialect = (csv_dialect) {
+    .separator = LIBCSV_DEFAULT_SEPARATOR,
+    .quote = '"',
+    .trim = true,
+    .cr_newline = true,
+  };
+  writer->scan_block = csv_scan_block_select();
+  writer->row_columns = 0;
+  writer->value_empty = false;
+
+  writer->size = 0;
+  writer->capacity = LIBCSV_WRITER_BUFFER_SIZE;
+
+  return writer;
+}
+
+void csv_writer_free(csv_writer *writer) {
+  if (writer == NULL) {
+    return;
+  }
+
+  csv_writer_flush(writer);
+  csv_free(&writer->allocator, writer->buffer);
+
+  csv_allocator copy = writer->allocator;
+  csv_free(&copy, writer);
+}
+
+char csv_writer_get_separator(const csv_writer *writer) {
+  return writer->dialect.separator;
+}
+
+void csv_writer_set_separator(csv_writer *writer, char separator) {
+  writer->dialect.separator = separator;
+}
+
+csv_dialect csv_writer_get_dialect(const csv_writer *writer) {
+  return writer->dialect;
+}
+
+bool csv_writer_set_dialect(csv_writer *writer, csv_dialect dialect) {
+  if (!csv_dialect_valid(dialect)) {
+    return false;
+  }
+
+  writer->dialect = dialect;
+  return true;
+}
+
+bool csv_writer_flush(csv_writer *writer) {
+  if (writer->size != 0 && !writer->failed) {
+    writer->failed = !(writer->callback)(writer->buffer, writer->size, writer->callback_data);
+  }
+  writer->size = 0;
+
+  return !writer->failed;
+}
+
+static void csv_writer_put(csv_writer *writer, const char *data, size_t length) {
+  if (length == 0) {
+    return;
+  }
+
+  if (length > writer->capacity - writer->size) {
+    csv_writer_flush(writer);
+
+    if (length >= writer->capacity) {
+      /* Large value is passed through without copying */
+      if (!writer->failed) {
+        writer->failed = !(writer->callback)(data, length, writer->callback_data);
+      }
+      return;
+    }
+  }
+
+  memcpy(writer->buffer + writer->size, data, length);
+  writer->size += length;
+}
+
+static void csv_writer_put_char(csv_writer *writer, char c) {
+  if (writer->size == writer->capacity) {
+    csv_writer_flush(writer);
+  }
+
+  writer->buffer[writer->size] = c;
+  ++writer->size;
+}
+
+/* Checks whether value would not be read back as is without quotes */
+static bool csv_writer_needs_quotes(const csv_writer *writer, const char *value, size_t length) {
+  if (length == 0) {
+    return false;
+  }
+
+  /* Unescaped values are trimmed */
+  if (
+    writer->dialect.trim &&
+    (value[0] == ' ' || value[0] == '\t' || value[length - 1] == ' ' || value[length - 1] == '\t')
+  ) {
+    return true;
+  }
+
+  uint64_t plain, escaped;
+  size_t i = 0;
+
+  for (; length - i >= LIBCSV_SCAN_BLOCK; i += LIBCSV_SCAN_BLOCK) {
+    writer->scan_block(value + i, writer->dialect.separator, writer->dialect.quote, &plain, &escaped);
+    if ((plain | escaped) != 0) {
+      return true;
+    }
+  }
+
+  if (i == length) {
+    return false;
+  }
+
+  char block[LIBCSV_SCAN_BLOCK] = {0};
+  memcpy(block, value + i, length - i);
+  writer->scan_block(block, writer->dialect.separator, writer->dialect.quote, &plain, &escaped);
+  return ((plain | escaped) & ((UINT64_C(1) << (length - i)) - 1)) != 0;
+}
+
+void csv_writer_write_value(csv_writer *writer, const char *value) {
+  csv_writer_write_value_length(writer, value, value == NULL ? 0 : strlen(value));
+}
+
+void csv_writer_write_value_length(csv_writer *writer, const char *value, size_t length) {
+  if (writer->row_columns != 0) {
+    csv_writer_put_char(writer, writer->dialect.separator);
+  }
+  ++writer->row_columns;
+  writer->value_empty = length == 0;
+
+  if (!csv_writer_needs_quotes(writer, value, length)) {
+    csv_writer_put(writer, value, length);
+    return;
+  }
+
+  char quote_char = writer->dialect.quote;
+  csv_writer_put_char(writer, quote_char);
+
+  const char *end = value + length;
+  for (const char *quote; (quote = memchr(value, quote_char, end - value)) != NULL; value = quote + 1) {
+    csv_writer_put(writer, value, quote + 1 - value);
+    csv_writer_put_char(writer, quote_char);
+  }
+  csv_writer_put(writer, value, end - value);
+
+  csv_writer_put_char(writer, quote_char);
+}
+
+void csv_writer_write_int64(csv_writer *writer, int64_t value) {
+  char buffer[24];
+  char *end = buffer + sizeof(buffer);
+  char *begin = format_uint64(value < 0 ? -(uint64_t) value : (uint64_t) value, end);
+  if (value < 0) {
+    *--begin = '-';
+  }
+
+  csv_writer_write_value_length(writer, begin, end - begin);
+}
+
+void csv_writer_write_uint64(csv_writer *writer, uint64_t value) {
+  char buffer[24];
+  char *end = buffer + sizeof(buffer);
+  char *begin = format_uint64(value, end);
+
+  csv_writer_write_value_length(writer, begin, end - begin);
+}
+
+void csv_writer_write_float(csv_writer *writer, float value) {
+  char buffer[LIBCSV_NUMBER_BUFFER + 1];
+  csv_writer_write_value_length(writer, buffer, format_float(&writer->allocator, value, true, buffer));
+}
+
+void csv_writer_write_double(csv_writer *writer, double value) {
+  char buffer[LIBCSV_NUMBER_BUFFER + 1];
+  csv_writer_write_value_length(writer, buffer, format_float(&writer->allocator, value, false, buffer));
+}
+
+void csv_writer_write_bool(csv_writer *writer, bool value) {
+  if (value) {
+    csv_writer_write_value_length(writer, "true", 4);
+  } else {
+    csv_writer_write_value_length(writer, "false", 5);
+  }
+}
+
+void csv_writer_end_row(csv_writer *writer) {
+  if (writer->row_columns == 1 && writer->value_empty) {
+    /* Empty line is skipped by parser */
+    csv_writer_put(writer, "\"\"", 2);
+  }
+
+  csv_writer_put_char(writer, '\n');
+  writer->row_columns = 0;
+}
+
+void csv_writer_write_header(csv_writer *writer, const csv_table *table) {
+  for (size_t i = 0; i < table->columns_count; ++i) {
+    csv_writer_write_value(writer, table->columns[i].name);
+  }
 
-    case TABLE_STATE_COLUMN_IN:
-      if (c == '\n' || c == '\r') {
-        csv_table_state_cs_flush(table, true);
-        csv_table_state_flush_row(table);
-        state = TABLE_STATE_NEWLINE;
-        --begin;
-      } else if (c == table->separator) {
-        csv_table_state_cs_flush(table, true);
-        state = TABLE_STATE_COLUMN_BEGIN;
-      } else {
-        csv_table_state_cs_put(table, c);
+  csv_writer_end_row(writer);
+}
+
+void csv_writer_write_row(csv_writer *writer, const csv_row *row) {
+  const csv_table *table = row->table;
+
+  for (size_t i = 0; i < table->columns_count; ++i) {
+    const csv_column *column = &table->columns[i];
+
+    switch (csv_table_column_type(table, i)) {
+    case CSV_TYPE_STRING:
+      csv_writer_write_value_length(writer, csv_row_value(row, column), csv_row_value_length(row, column));
+      continue;
+
+    case CSV_TYPE_INT8:
+    case CSV_TYPE_INT16:
+    case CSV_TYPE_INT32:
+    case CSV_TYPE_INT64: {
+      int64_t value;
+      if (csv_row_value_int64(row, column, &value)) {
+        csv_writer_write_int64(writer, value);
+        continue;
       }
       break;
+    }
 
-    case TABLE_STATE_COLUMN_IN_ESCAPE:
-      if (c == '"') {
-        state = TABLE_STATE_COLUMN_IN_ESCAPE_ESCAPE;
-      } else {
-        csv_table_state_cs_put(table, c);
+    case CSV_TYPE_UINT8:
+    case CSV_TYPE_UINT16:
+    case CSV_TYPE_UINT32:
+    case CSV_TYPE_UINT64: {
+      uint64_t value;
+      if (csv_row_value_uint64(row, column, &value)) {
+        csv_writer_write_uint64(writer, value);
+        continue;
       }
       break;
+    }
 
-    case TABLE_STATE_COLUMN_IN_ESCAPE_ESCAPE:
-      if (c == '"') {
-        csv_table_state_cs_put(table, c);
-        state = TABLE_STATE_COLUMN_IN_ESCAPE;
-      } else {
-        state = TABLE_STATE_COLUMN_IN_ESCAPE_END;
-        --begin;
+    case CSV_TYPE_FLOAT: {
+      float value;
+      if (csv_row_value_float(row, column, &value)) {
+        csv_writer_write_float(writer, value);
+        continue;
       }
       break;
+    }
 
-    case TABLE_STATE_COLUMN_IN_ESCAPE_END:
-      if (c == ' ' || c == '\t') {
-        /* Skip whitespace */
-      } else if (c == '\n' || c == '\r') {
-        csv_table_state_cs_flush(table, false);
-        csv_table_state_flush_row(table);
-        state = TABLE_STATE_NEWLINE;
-        --begin;
-      } else if (c == table->separator) {
-        csv_table_state_cs_flush(table, false);
-        state = TABLE_STATE_COLUMN_BEGIN;
-      } else {
-        if (table->error_callback != NULL) {
-          (table->error_callback)(
-            "Unexpected symbol after end of escaped string",
-            table->state_line, table->state_column, table->error_callback_data
-          );
-        }
+    case CSV_TYPE_DOUBLE: {
+      double value;
+      if (csv_row_value_double(row, column, &value)) {
+        csv_writer_write_double(writer, value);
+        continue;
       }
       break;
     }
 
-    if (cp == begin) {
-      if (c == '\n') {
-        ++table->state_line;
-        table->state_column = 0;
-      } else {
-        ++table->state_column;
+    case CSV_TYPE_BOOL: {
+      bool value;
+      if (csv_row_value_bool_typed(row, column, &value)) {
+        csv_writer_write_bool(writer, value);
+        continue;
       }
+      break;
     }
-    ++begin;
+    }
+
+    /* Missing value */
+    csv_writer_write_value_length(writer, NULL, 0);
   }
 
-  table->state = state;
+  csv_writer_end_row(writer);
 }
 
 
-size_t csv_table_column_count(const csv_table *table) {
-  return table->columns_count;
-}
+/* Arena */
 
-csv_column *csv_table_column(const csv_table *table, size_t index) {
-  if (index >= table->columns_count) {
-    return NULL;
-  }
+/* Allocations are aligned to it, each one is preceded by its size, so realloc can copy it */
+#define LIBCSV_ARENA_ALIGNMENT 16
 
-  return &table->columns[index];
-}
+struct csv_arena_block {
+  struct csv_arena_block *next;
+  size_t capacity;
+  _Alignas(LIBCSV_ARENA_ALIGNMENT) char data[];
+};
 
-csv_column *csv_table_column_by_name(const csv_table *table, const char *name) {
-  for (size_t i = table->columns_count; i --> 0; ) {
-    if (strcmp(table->columns[i].name, name) == 0) {
-      return &table->columns[i];
-    }
-  }
+struct csv_arena {
+  size_t block_size;
+  struct csv_arena_block *first;
+  struct csv_arena_block *current; /* blocks after it are free, they are reused after reset */
+  size_t current_used;
+  char *last; /* the latest allocation, which realloc grows in place */
+  size_t used, capacity;
+#ifdef LIBCSV_HAVE_PTHREAD
+  pthread_mutex_t mutex;
+#endif
+};
 
-  return NULL;
+static size_t csv_arena_align(size_t size) {
+  return (size + LIBCSV_ARENA_ALIGNMENT - 1) & ~(size_t) (LIBCSV_ARENA_ALIGNMENT - 1);
 }
 
+/* Takes size bytes from the current block, or from the next one which is large enough */
+static char *csv_arena_take(csv_arena *arena, size_t size) {
+  struct csv_arena_block *block = arena->current;
 
-bool csv_table_has_header(const csv_table *table) {
-  return table->has_header;
-}
+  if (block == NULL || block->capacity - arena->current_used < size) {
+    struct csv_arena_block *previous = block;
+    block = block == NULL ? arena->first : block->next;
+    while (block != NULL && block->capacity < size) {
+      previous = block;
+      block = block->next;
+    }
 
-bool csv_table_has_row(const csv_table *table) {
-  return table->rows_begin != table->rows_end;
-}
+    if (block == NULL) {
+      size_t capacity = size > arena->block_size ? size : arena->block_size;
+      block = malloc(sizeof(struct csv_arena_block) + capacity);
+      if (block == NULL) {
+        return NULL;
+      }
 
-size_t csv_table_available_rows(const csv_table *table) {
-  if (table->rows_begin > table->rows_end) {
-    return table->rows_capacity - table->rows_begin + table->rows_end;
+      block->capacity = capacity;
+      block->next = NULL;
+      if (previous == NULL) {
+        arena->first = block;
+      } else {
+        block->next = previous->next;
+        previous->next = block;
+      }
+      arena->capacity += capacity;
+    }
+
+    arena->current = block;
+    arena->current_used = 0;
   }
 
-  return table->rows_end - table->rows_begin;
+  char *result = block->data + arena->current_used;
+  arena->current_used += size;
+  arena->used += size;
+  return result;
 }
 
-csv_row *csv_table_next_row(csv_table *table) {
-  if (table->rows_begin == table->rows_end) {
+static void *csv_arena_alloc_locked(csv_arena *arena, size_t size) {
+  size = csv_arena_align(size);
+
+  char *block = csv_arena_take(arena, LIBCSV_ARENA_ALIGNMENT + size);
+  if (block == NULL) {
     return NULL;
   }
 
-  csv_row *row = table->rows_queue[table->rows_begin];
-  ++table->rows_begin;
-  table->rows_begin &= table->rows_capacity_mask;
-
-  return row;
+  *(size_t *) block = size;
+  arena->last = block + LIBCSV_ARENA_ALIGNMENT;
+  return arena->last;
 }
 
-
-/* Column */
-size_t csv_column_index(const csv_column *column) {
-  return column->index;
+static void csv_arena_lock(csv_arena *arena) {
+#ifdef LIBCSV_HAVE_PTHREAD
+  pthread_mutex_lock(&arena->mutex);
+#else
+  (void) arena;
+#endif
 }
 
-const char *csv_column_name(const csv_column *column) {
-  return column->name;
+static void csv_arena_unlock(csv_arena *arena) {
+#ifdef LIBCSV_HAVE_PTHREAD
+  pthread_mutex_unlock(&arena->mutex);
+#else
+  (void) arena;
+#endif
 }
 
+static void *csv_arena_alloc(size_t size, void *context) {
+  csv_arena *arena = context;
 
-/* Row */
-size_t csv_row_index(const csv_row *row) {
-  return row->index;
+  csv_arena_lock(arena);
+  void *result = csv_arena_alloc_locked(arena, size);
+  csv_arena_unlock(arena);
+
+  return result;
 }
 
-bool csv_row_empty(const csv_row *row, const csv_column *column) {
-  if (row == NULL) {
-    return true;
+static void *csv_arena_realloc(void *ptr, size_t size, void *context) {
+  csv_arena *arena = context;
+  if (ptr == NULL) {
+    return csv_arena_alloc(size, context);
+  }
+
+  size_t *header = (size_t *) ((char *) ptr - LIBCSV_ARENA_ALIGNMENT);
+  size_t old_size = *header;
+  void *result = ptr;
+
+  csv_arena_lock(arena);
+  if (size > old_size) {
+    size_t extra = csv_arena_align(size) - old_size;
+
+    if (ptr == arena->last && arena->current->capacity - arena->current_used >= extra) {
+      /* The latest allocation is at the end of the current block, so it grows in place */
+      arena->current_used += extra;
+      arena->used += extra;
+      *header += extra;
+    } else {
+      result = csv_arena_alloc_locked(arena, size);
+      if (result != NULL) {
+        memcpy(result, ptr, old_size);
+      }
+    }
   }
+  csv_arena_unlock(arena);
 
-  const char *value = row->values[column->index];
-  return value == NULL || value[0] == '\0';
+  return result;
 }
 
+static void csv_arena_release(void *ptr, void *context) {
+  (void) ptr;
+  (void) context;
+}
 
-const char *csv_row_value(const csv_row *row, const csv_column *column) {
-  assert(row->table == column->table);
+csv_arena *csv_arena_create(size_t block_size) {
+  csv_arena *arena = malloc(sizeof(csv_arena));
+  if (arena == NULL) {
+    return NULL;
+  }
 
-  return row->values[column->index];
-}
+  arena->block_size = block_size == 0 ? LIBCSV_DEFAULT_ARENA_BLOCK_SIZE : csv_arena_align(block_size);
+  arena->first = arena->current = NULL;
+  arena->current_used = 0;
+  arena->last = NULL;
+  arena->used = arena->capacity = 0;
+#ifdef LIBCSV_HAVE_PTHREAD
+  pthread_mutex_init(&arena->mutex, NULL);
+#endif
 
-const char *csv_row_value_default(const csv_row *row, const csv_column *column, const char *def) {
-  const char *value = csv_row_value(row, column);
-  return *value == '\0' ? def : value;
+  return arena;
 }
 
+void csv_arena_free(csv_arena *arena) {
+  if (arena == NULL) {
+    return;
+  }
 
-bool csv_row_value_int8(const csv_row *row, const csv_column *column, int8_t *result) {
-  const char *value = csv_row_value(row, column);
-  int pos = 0;
-  return sscanf(value, "%" SCNd8 "%n", result, &pos) == 1 && value[pos] == '\0';
+  while (arena->first != NULL) {
+    struct csv_arena_block *block = arena->first;
+    arena->first = block->next;
+    free(block);
+  }
+
+#ifdef LIBCSV_HAVE_PTHREAD
+  pthread_mutex_destroy(&arena->mutex);
+#endif
+  free(arena);
 }
 
-int8_t csv_row_value_int8_default(const csv_row *row, const csv_column *column, int8_t def) {
-  int8_t result;
-  return csv_row_value_int8(row, column, &result) ? result : def;
+void csv_arena_reset(csv_arena *arena) {
+  csv_arena_lock(arena);
+  arena->current = NULL;
+  arena->current_used = 0;
+  arena->last = NULL;
+  arena->used = 0;
+  csv_arena_unlock(arena);
 }
 
+csv_allocator csv_arena_allocator(csv_arena *arena) {
+  return (csv_allocator) {csv_arena_alloc, csv_arena_realloc, csv_arena_release, arena};
+}
 
-bool csv_row_value_uint8(const csv_row *row, const csv_column *column, uint8_t *result) {
-  const char *value = csv_row_value(row, column);
-  int pos;
-  return sscanf(value, "%" SCNu8 "%n", result, &pos) == 1 && value[pos] == '\0';
+size_t csv_arena_used(const csv_arena *arena) {
+  return arena->used;
 }
 
-uint8_t csv_row_value_uint8_default(const csv_row *row, const csv_column *column, uint8_t def) {
-  uint8_t result;
-  return csv_row_value_uint8(row, column, &result) ? result : def;
+size_t csv_arena_capacity(const csv_arena *arena) {
+  return arena->capacity;
 }
 
 
-bool csv_row_value_int16(const csv_row *row, const csv_column *column, int16_t *result) {
-  const char *value = csv_row_value(row, column);
-  int pos;
-  return sscanf(value, "%" SCNd16 "%n", result, &pos) == 1 && value[pos] == '\0';
-}
+/* Follow */
+#ifdef LIBCSV_HAVE_FOLLOW
+struct csv_follower {
+  csv_table *table;
+  char *path;
+  const char *name; /* of the file in its directory, which is watched */
+  int fd;
+  dev_t device;
+  ino_t inode;
+  off_t offset; /* read from fd */
+  char tail[LIBCSV_FOLLOW_CHECK_SIZE]; /* last read bytes, which are compared to detect file rewritten in place */
+  size_t tail_length;
+  bool skip_line; /* the first line of rotated or truncated file is its header */
+  int inotify; /* -1 if file is checked every LIBCSV_FOLLOW_POLL_INTERVAL milliseconds */
+  int stop_pipe[2];
+  atomic_bool stopped;
+  char *buffer;
+};
 
-int16_t csv_row_value_int16_default(const csv_row *row, const csv_column *column, int16_t def) {
-  int16_t result;
-  return csv_row_value_int16(row, column, &result) ? result : def;
-}
+static bool csv_follower_open(csv_follower *follower) {
+  int fd = open(follower->path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
 
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return false;
+  }
 
-bool csv_row_value_uint16(const csv_row *row, const csv_column *column, uint16_t *result) {
-  const char *value = csv_row_value(row, column);
-  int pos;
-  return sscanf(value, "%" SCNu16 "%n", result, &pos) == 1 && value[pos] == '\0';
+  follower->fd = fd;
+  follower->device = st.st_dev;
+  follower->inode = st.st_ino;
+  follower->offset = 0;
+  follower->tail_length = 0;
+  return true;
 }
 
-uint16_t csv_row_value_uint16_default(const csv_row *row, const csv_column *column, uint16_t def) {
-  uint16_t result;
-  return csv_row_value_uint16(row, column, &result) ? result : def;
-}
+/* Feeds table with data up to the end of file, returns number of read bytes */
+static size_t csv_follower_drain(csv_follower *follower) {
+  size_t total = 0;
+
+  for (;;) {
+    ssize_t length = read(follower->fd, follower->buffer, LIBCSV_FOLLOW_BLOCK_SIZE);
+    if (length < 0 && errno == EINTR) {
+      continue;
+    }
+    if (length <= 0) {
+      return total;
+    }
 
+    follower->offset += length;
+    total += (size_t) length;
 
-bool csv_row_value_int32(const csv_row *row, const csv_column *column, int32_t *result) {
-  const char *value = csv_row_value(row, column);
-  int pos;
-  return sscanf(value, "%" SCNd32 "%n", result, &pos) == 1 && value[pos] == '\0';
-}
+    if ((size_t) length >= sizeof(follower->tail)) {
+      follower->tail_length = sizeof(follower->tail);
+      memcpy(follower->tail, follower->buffer + length - sizeof(follower->tail), sizeof(follower->tail));
+    } else {
+      size_t keep = sizeof(follower->tail) - (size_t) length;
+      if (keep > follower->tail_length) {
+        keep = follower->tail_length;
+      }
 
-int32_t csv_row_value_int32_default(const csv_row *row, const csv_column *column, int32_t def) {
-  int32_t result;
-  return csv_row_value_int32(row, column, &result) ? result : def;
-}
+      memmove(follower->tail, follower->tail + follower->tail_length - keep, keep);
+      memcpy(follower->tail + keep, follower->buffer, (size_t) length);
+      follower->tail_length = keep + (size_t) length;
+    }
 
+    const char *data = follower->buffer, *end = data + length;
+    if (follower->skip_line) {
+      const char *newline = memchr(data, '\n', end - data);
+      if (newline == NULL) {
+        continue;
+      }
 
-bool csv_row_value_uint32(const csv_row *row, const csv_column *column, uint32_t *result) {
-  const char *value = csv_row_value(row, column);
-  int pos;
-  return sscanf(value, "%" SCNu32 "%n", result, &pos) == 1 && value[pos] == '\0';
-}
+      follower->skip_line = false;
+      data = newline + 1;
+    }
 
-uint32_t csv_row_value_uint32_default(const csv_row *row, const csv_column *column, uint32_t def) {
-  uint32_t result;
-  return csv_row_value_uint32(row, column, &result) ? result : def;
+    csv_table_add_data_length(follower->table, data, end - data);
+  }
 }
 
+/* Checks whether data before offset is not the read one anymore (file is truncated, maybe written again since then) */
+static bool csv_follower_truncated(csv_follower *follower) {
+  struct stat st;
+  if (fstat(follower->fd, &st) != 0) {
+    return false;
+  }
 
-bool csv_row_value_int64(const csv_row *row, const csv_column *column, int64_t *result) {
-  const char *value = csv_row_value(row, column);
-  int pos;
-  return sscanf(value, "%" SCNd64 "%n", result, &pos) == 1 && value[pos] == '\0';
-}
+  if (st.st_size < follower->offset) {
+    return true;
+  }
 
-int64_t csv_row_value_int64_default(const csv_row *row, const csv_column *column, int64_t def) {
-  int64_t result;
-  return csv_row_value_int64(row, column, &result) ? result : def;
+  if (follower->tail_length == 0) {
+    return false;
+  }
+
+  char tail[LIBCSV_FOLLOW_CHECK_SIZE];
+  ssize_t length = pread(follower->fd, tail, follower->tail_length, follower->offset - follower->tail_length);
+  return length != (ssize_t) follower->tail_length || memcmp(tail, follower->tail, follower->tail_length) != 0;
 }
 
+/* Handles truncation and rotation of file, then reads new data */
+static size_t csv_follower_read(csv_follower *follower) {
+  if (csv_follower_truncated(follower)) {
+    /* Truncated file is read from the beginning */
+    lseek(follower->fd, 0, SEEK_SET);
+    follower->offset = 0;
+    follower->tail_length = 0;
+    follower->skip_line = true;
+    csv_table_drop_row(follower->table);
+  }
 
-bool csv_row_value_uint64(const csv_row *row, const csv_column *column, uint64_t *result) {
-  const char *value = csv_row_value(row, column);
-  int pos;
-  return sscanf(value, "%" SCNu64 "%n", result, &pos) == 1 && value[pos] == '\0';
-}
+  size_t total = csv_follower_drain(follower);
+
+  struct stat st;
+  if (stat(follower->path, &st) == 0 && (st.st_dev != follower->device || st.st_ino != follower->inode)) {
+    /* File is replaced, the old one is read up to its end already */
+    int fd = follower->fd;
+    if (csv_follower_open(follower)) {
+      close(fd);
+      follower->skip_line = true;
+      csv_table_drop_row(follower->table);
+      total += csv_follower_drain(follower);
+    }
+  }
 
-uint64_t csv_row_value_uint64_default(const csv_row *row, const csv_column *column, uint64_t def) {
-  uint64_t result;
-  return csv_row_value_uint64(row, column, &result) ? result : def;
+  return total;
 }
 
+#ifdef LIBCSV_HAVE_INOTIFY
+/* Reads pending events, returns true if some of them is about the followed file */
+static bool csv_follower_read_events(csv_follower *follower) {
+  _Alignas(struct inotify_event) char events[sizeof(struct inotify_event) * 16 + NAME_MAX + 1];
+  bool relevant = false;
 
-bool csv_row_value_float(const csv_row *row, const csv_column *column, float *result) {
-  const char *value = csv_row_value(row, column);
-  int pos;
-  return sscanf(value, "%f%n", result, &pos) == 1 && value[pos] == '\0';
-}
+  for (;;) {
+    ssize_t length = read(follower->inotify, events, sizeof(events));
+    if (length < 0 && errno == EINTR) {
+      continue;
+    }
+    if (length <= 0) {
+      return relevant;
+    }
 
-float csv_row_value_float_default(const csv_row *row, const csv_column *column, float def) {
-  float result;
-  return csv_row_value_float(row, column, &result) ? result : def;
-}
+    for (const char *it = events; it < events + length; ) {
+      const struct inotify_event *event = (const struct inotify_event *) it;
 
+      if (event->mask & (IN_Q_OVERFLOW | IN_IGNORED)) {
+        relevant = true;
+      } else if (event->len != 0 && strcmp(event->name, follower->name) == 0) {
+        relevant = true;
+      }
 
-bool csv_row_value_double(const csv_row *row, const csv_column *column, double *result) {
-  const char *value = csv_row_value(row, column);
-  int pos;
-  return sscanf(value, "%lf%n", result, &pos) == 1 && value[pos] == '\0';
+      if (event->mask & IN_IGNORED) {
+        /* Directory is gone, so file is checked periodically */
+        close(follower->inotify);
+        follower->inotify = -1;
+        return true;
+      }
+
+      it += sizeof(struct inotify_event) + event->len;
+    }
+  }
 }
+#endif
 
-double csv_row_value_double_default(const csv_row *row, const csv_column *column, double def) {
-  double result;
-  return csv_row_value_double(row, column, &result) ? result : def;
+static int64_t csv_follower_now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
 }
+#endif
+
+csv_follower *csv_follower_create(csv_table *table, const char *path) {
+#ifdef LIBCSV_HAVE_FOLLOW
+  size_t path_length = strlen(path);
+  csv_follower *follower = csv_alloc(&table->allocator, sizeof(csv_follower));
+  follower->table = table;
+  follower->path = csv_alloc(&table->allocator, path_length + 1);
+  memcpy(follower->path, path, path_length + 1);
+  follower->skip_line = false;
+  follower->inotify = -1;
+  follower->stop_pipe[0] = follower->stop_pipe[1] = -1;
+  atomic_init(&follower->stopped, false);
+  follower->buffer = NULL;
+
+  const char *slash = strrchr(follower->path, '/');
+  follower->name = slash == NULL ? follower->path : slash + 1;
+
+  if (!csv_follower_open(follower)) {
+    csv_free(&table->allocator, follower->path);
+    csv_free(&table->allocator, follower);
+    return NULL;
+  }
 
+  if (pipe(follower->stop_pipe) != 0) {
+    follower->stop_pipe[0] = follower->stop_pipe[1] = -1;
+    csv_follower_free(follower);
+    return NULL;
+  }
+  for (size_t i = 0; i < 2; ++i) {
+    fcntl(follower->stop_pipe[i], F_SETFD, FD_CLOEXEC);
+    fcntl(follower->stop_pipe[i], F_SETFL, O_NONBLOCK);
+  }
 
-bool csv_row_value_bool(const csv_row *row, const csv_column *column) {
-  return csv_row_value_bool_default(row, column, false);
+#ifdef LIBCSV_HAVE_INOTIFY
+  follower->inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (follower->inotify >= 0) {
+    /* Directory is watched, so the file is followed once it is replaced */
+    size_t directory_length = slash == NULL ? 1 : slash == follower->path ? 1 : (size_t) (slash - follower->path);
+    char *directory = csv_alloc(&table->allocator, directory_length + 1);
+    memcpy(directory, slash == NULL ? "." : follower->path, directory_length);
+    directory[directory_length] = '\0';
+
+    int watch = inotify_add_watch(
+      follower->inotify,
+      directory,
+      IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE
+    );
+    csv_free(&table->allocator, directory);
+
+    if (watch < 0) {
+      close(follower->inotify);
+      follower->inotify = -1;
+    }
+  }
+#endif
+
+  follower->buffer = csv_alloc(&table->allocator, LIBCSV_FOLLOW_BLOCK_SIZE);
+  return follower;
+#else
+  (void) table;
+  (void) path;
+  errno = ENOSYS;
+  return NULL;
+#endif
 }
 
-bool csv_row_value_bool_default(const csv_row *row, const csv_column *column, bool def) {
-  static const char *truth_values[] = {
-    "1",
-    "t",
-    "true",
-    "ok",
-    "okay",
-    "yes",
-    "yep",
-    "yeah",
-    NULL,
-  };
+void csv_follower_free(csv_follower *follower) {
+#ifdef LIBCSV_HAVE_FOLLOW
+  if (follower == NULL) {
+    return;
+  }
 
-  static const char *falsy_values[] = {
-    "0",
-    "f",
-    "false",
-    "not",
-    "no",
-    "nope",
-    "never",
-    NULL,
-  };
+  const csv_allocator *allocator = &follower->table->allocator;
+
+  close(follower->fd);
+  for (size_t i = 0; i < 2; ++i) {
+    if (follower->stop_pipe[i] >= 0) {
+      close(follower->stop_pipe[i]);
+    }
+  }
+  if (follower->inotify >= 0) {
+    close(follower->inotify);
+  }
 
-  const char *value = csv_row_value(row, column);
+  csv_free(allocator, follower->buffer);
+  csv_free(allocator, follower->path);
+  csv_free(allocator, follower);
+#else
+  (void) follower;
+#endif
+}
 
-  if (def == false) {
-    for (const char **truth_value = truth_values; *truth_value; ++truth_value) {
-      if (equals_ignore_case(value, *truth_value)) {
-        return true;
-      }
+size_t csv_follower_poll(csv_follower *follower, int timeout) {
+#ifdef LIBCSV_HAVE_FOLLOW
+  int64_t deadline = timeout < 0 ? INT64_MAX : csv_follower_now() + timeout;
+  bool check = true;
+
+  for (;;) {
+    if (atomic_load_explicit(&follower->stopped, memory_order_acquire)) {
+      return 0;
     }
 
-    return false;
-  } else {
-    for (const char **falsy_value = falsy_values; *falsy_value; ++falsy_value) {
-      if (equals_ignore_case(value, *falsy_value)) {
-        return false;
+    if (check) {
+      size_t length = csv_follower_read(follower);
+      if (length != 0) {
+        return length;
       }
     }
 
-    return true;
-  }
-}
+    int64_t now = csv_follower_now();
+    if (now >= deadline) {
+      return 0;
+    }
+
+    int wait = deadline - now > INT_MAX ? -1 : (int) (deadline - now);
+    if (follower->inotify < 0 && (wait < 0 || wait > LIBCSV_FOLLOW_POLL_INTERVAL)) {
+      wait = LIBCSV_FOLLOW_POLL_INTERVAL;
+    }
 
+    struct pollfd fds[2] = {
+      {.fd = follower->stop_pipe[0], .events = POLLIN},
+      {.fd = follower->inotify, .events = POLLIN},
+    };
+    check = true;
+    if (poll(fds, follower->inotify < 0 ? 1 : 2, wait) <= 0) {
+      continue;
+    }
 
-void csv_row_free(csv_row *row) {
-  if (row == NULL) {
-    return;
+#ifdef LIBCSV_HAVE_INOTIFY
+    /* Events of other files in directory do not need the file to be checked */
+    if (follower->inotify >= 0 && (fds[1].revents & POLLIN) && !(fds[0].revents & POLLIN)) {
+      check = csv_follower_read_events(follower);
+    }
+#endif
   }
+#else
+  (void) follower;
+  (void) timeout;
+  return 0;
+#endif
+}
 
-  for (size_t i = row->table->columns_count; i --> 0; ) {
-    free(row->values[i]);
-  }
+void csv_follower_stop(csv_follower *follower) {
+#ifdef LIBCSV_HAVE_FOLLOW
+  atomic_store_explicit(&follower->stopped, true, memory_order_release);
 
-  free(row);
+  char byte = 0;
+  ssize_t result = write(follower->stop_pipe[1], &byte, 1);
+  (void) result;
+#else
+  (void) follower;
+#endif
 }
@@ -17,9 +17,13 @@
 #include <gtest/gtest.h>
 #include <libcsv.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <fstream>
 #include <string>
 #include <random>
+#include <thread>
 
 using namespace std;
 using namespace libcsv;
@@ -28,6 +32,7 @@ using namespace libcsv;
 #define $
 
 static string mlb_players;
+static string mlb_players_path;
 
 
 bool print_errors(CSVTable &table) {
@@ -529,6 +534,178 @@ TEST(CSVTable, chunked_reading) {
   $ ASSERT_FALSE(table2.hasError());
 }
 
+TEST(CSVTable, long_fields) {
+  /* Fields longer than scanner block, parsed at once and byte by byte */
+
+  string plain(150, 'a');
+  string escaped = "x,\"\"y\n" + string(100, 'b') + "\r\nz";
+  string escaped_source = "\"x,\"\"\"\"y\n" + string(100, 'b') + "\r\nz\"";
+
+  string data = "Col1,Col2,Col3\r\n";
+  for (int i = 0; i < 8; ++i) {
+    data += plain + "," + escaped_source + ", " + plain.substr(i * 16) + " \r\n";
+  }
+
+  CSVTable table1, table2;
+
+  table1.addData(data);
+  for (char c : data) {
+    table2.addData(&c, 1);
+  }
+
+  $ ASSERT_FALSE(table1.hasError());
+  $ ASSERT_FALSE(table2.hasError());
+  $ ASSERT_EQ(table1.availableRows(), 8);
+  $ ASSERT_EQ(table2.availableRows(), 8);
+
+  CSVColumn c1_col1 = table1.getColumn("Col1");
+  CSVColumn c1_col2 = table1.getColumn("Col2");
+  CSVColumn c1_col3 = table1.getColumn("Col3");
+  CSVColumn c2_col1 = table2.getColumn("Col1");
+  CSVColumn c2_col2 = table2.getColumn("Col2");
+  CSVColumn c2_col3 = table2.getColumn("Col3");
+
+  CSVRow row1, row2;
+  for (int i = 0; i < 8; ++i) {
+    row1 = table1.nextRow();
+    row2 = table2.nextRow();
+    $ ASSERT_TRUE(row1);
+    $ ASSERT_TRUE(row2);
+
+    $ ASSERT_EQ(row1.getValue(c1_col1), plain);
+    $ ASSERT_EQ(row1.getValue(c1_col2), escaped);
+    $ ASSERT_EQ(row1.getValue(c1_col3), plain.substr(i * 16));
+
+    $ ASSERT_EQ(row2.getValue(c2_col1), plain);
+    $ ASSERT_EQ(row2.getValue(c2_col2), escaped);
+    $ ASSERT_EQ(row2.getValue(c2_col3), plain.substr(i * 16));
+  }
+}
+
+TEST(CSVTable, retained_data) {
+  static const string chunks[] = {
+    "Col1,Col2,Col3\n",
+    "Value1, \"Value2\" ,\"Val\"\"ue3\"\n",
+    "Value4,Val",
+    "ue5,Value6\n",
+  };
+
+  size_t released = 0;
+  auto release = [](const char *, size_t, void *data) {
+    ++*reinterpret_cast<size_t *>(data);
+  };
+
+  CSVTable table;
+  for (const string &chunk : chunks) {
+    table.addDataRetained(chunk.data(), chunk.size(), release, &released);
+  }
+
+  $ ASSERT_FALSE(table.hasError());
+  $ ASSERT_EQ(table.availableRows(), 2);
+
+  /* Header is copied, so only first chunk is released */
+  $ ASSERT_EQ(released, 1);
+
+  CSVColumn c_col1 = table.getColumn("Col1");
+  CSVColumn c_col2 = table.getColumn("Col2");
+  CSVColumn c_col3 = table.getColumn("Col3");
+
+  CSVRow row;
+
+  row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_EQ(row.getValue(c_col1), "Value1");
+  $ ASSERT_EQ(row.getValue(c_col2), "Value2");
+  $ ASSERT_EQ(row.getValue(c_col3), "Val\"ue3");
+  $ ASSERT_EQ(row.getValueOr(c_col1, false), false);
+
+  row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_EQ(row.getValue(c_col1), "Value4");
+  $ ASSERT_EQ(row.getValue(c_col2), "Value5");
+  $ ASSERT_EQ(row.getValue(c_col3), "Value6");
+
+  $ ASSERT_EQ(released, 2);
+  row = CSVRow {};
+  $ ASSERT_EQ(released, 4);
+}
+
+TEST(CSVTable, retained_data_references) {
+  static const char data[] = "a,b\n1,22\n";
+
+  csv_table *table = csv_table_create();
+  csv_table_add_data_retained(table, data, sizeof(data) - 1, nullptr, nullptr);
+
+  csv_column *c_b = csv_table_column_by_name(table, "b");
+  csv_row *row = csv_table_next_row(table);
+  $ ASSERT_NE(row, nullptr);
+  $ ASSERT_EQ(csv_row_value(row, c_b), data + 6);
+  $ ASSERT_EQ(csv_row_value_length(row, c_b), 2);
+
+  int8_t value;
+  $ ASSERT_TRUE(csv_row_value_int8(row, c_b, &value));
+  $ ASSERT_EQ(value, 22);
+
+  csv_row_free(row);
+  csv_table_free(table);
+}
+
+TEST(CSVTable, missing_values) {
+  CSVTable table;
+
+  table.addData("Col1,Col2,Col3\n");
+  table.addData("Value1,,\"\"\n");
+  table.addData("Value2\n");
+
+  $ ASSERT_FALSE(table.hasError());
+  $ ASSERT_EQ(table.availableRows(), 2);
+
+  CSVColumn c_col1 = table.getColumn("Col1");
+  CSVColumn c_col2 = table.getColumn("Col2");
+  CSVColumn c_col3 = table.getColumn("Col3");
+
+  CSVRow row;
+
+  row = table.nextRow();
+  $ ASSERT_EQ(row.getValue(c_col1), "Value1");
+  $ ASSERT_TRUE(row.isEmpty(c_col2));
+  $ ASSERT_TRUE(row.isEmpty(c_col3));
+  $ ASSERT_EQ(row.getValue(c_col3), "");
+
+  row = table.nextRow();
+  $ ASSERT_EQ(row.getIndex(), 1);
+  $ ASSERT_EQ(row.getValue(c_col1), "Value2");
+  $ ASSERT_TRUE(row.isEmpty(c_col2));
+  $ ASSERT_TRUE(row.isEmpty(c_col3));
+  $ ASSERT_EQ(row.getValue(c_col3), "");
+}
+
+TEST(CSVTable, files) {
+  CSVTable table1, table2, table3;
+
+  table1.addData(mlb_players);
+  $ ASSERT_TRUE(table2.openFile(mlb_players_path));
+  $ ASSERT_TRUE(table3.mapFile(mlb_players_path));
+  $ ASSERT_FALSE(table3.mapFile(mlb_players_path + ".not_exists"));
+
+  $ ASSERT_EQ(table1.getColumnCount(), table2.getColumnCount());
+  $ ASSERT_EQ(table1.getColumnCount(), table3.getColumnCount());
+  $ ASSERT_EQ(table1.availableRows(), table2.availableRows());
+  $ ASSERT_EQ(table1.availableRows(), table3.availableRows());
+
+  CSVRow row1, row2, row3;
+  while ((row1 = table1.nextRow()) && (row2 = table2.nextRow()) && (row3 = table3.nextRow())) {
+    for (size_t i = 0; i < table1.getColumnCount(); ++i) {
+      $ ASSERT_EQ(row1.getValue(table1.getColumn(i)), row2.getValue(table2.getColumn(i)));
+      $ ASSERT_EQ(row1.getValue(table1.getColumn(i)), row3.getValue(table3.getColumn(i)));
+    }
+  }
+
+  $ ASSERT_FALSE(table1.hasRow());
+  $ ASSERT_FALSE(table2.hasRow());
+  $ ASSERT_FALSE(table3.hasRow());
+}
+
 TEST(CSVTable, streaming) {
   CSVTable table;
 
@@ -602,6 +779,1026 @@ TEST(CSVTable, streaming) {
   $ ASSERT_FALSE(table.hasError());
 }
 
+TEST(CSVTable, row_pool) {
+  csv_table *table = csv_table_create();
+  csv_table_add_data(table, "Col1,Col2\nValue1,Value2\n");
+
+  csv_row *row1 = csv_table_next_row(table);
+  $ ASSERT_NE(row1, nullptr);
+  csv_table_recycle_row(table, row1);
+
+  /* Freed row is reused for the next one */
+  csv_table_add_data(table, "Value3,Value4\n");
+  csv_row *row2 = csv_table_next_row(table);
+  $ ASSERT_EQ(row1, row2);
+  $ ASSERT_EQ(csv_row_index(row2), 1);
+  $ ASSERT_STREQ(csv_row_value(row2, csv_table_column(table, 1)), "Value4");
+  csv_row_free(row2);
+
+  csv_table_set_row_pool_limit(table, 0);
+  $ ASSERT_EQ(csv_table_get_row_pool_limit(table), 0);
+
+  csv_table_add_data(table, "Value5,Value6\n");
+  csv_row *row3 = csv_table_next_row(table);
+  $ ASSERT_NE(row3, nullptr);
+  $ ASSERT_STREQ(csv_row_value(row3, csv_table_column(table, 0)), "Value5");
+  csv_row_free(row3);
+
+  csv_table_free(table);
+}
+
+TEST(CSVTable, column_lookup) {
+  CSVTable table;
+
+  string header = "Name,name,Other";
+  for (int i = 0; i < 300; ++i) {
+    header += ",column" + to_string(i);
+  }
+  header += ",other\n";
+  table.addData(header);
+
+  $ ASSERT_TRUE(table.hasHeader());
+  $ ASSERT_EQ(table.getColumnCount(), 304);
+
+  for (int i = 0; i < 300; ++i) {
+    CSVColumn column = table.getColumn("column" + to_string(i));
+    $ ASSERT_TRUE(column);
+    $ ASSERT_EQ(column.getIndex(), i + 3);
+    $ ASSERT_EQ(table.getColumnIgnoreCase("COLUMN" + to_string(i)).getIndex(), i + 3);
+  }
+
+  $ ASSERT_EQ(table.getColumn("Name").getIndex(), 0);
+  $ ASSERT_EQ(table.getColumn("name").getIndex(), 1);
+  $ ASSERT_EQ(table.getColumn("Other").getIndex(), 2);
+  $ ASSERT_EQ(table.getColumn("other").getIndex(), 303);
+
+  /* The last of columns with the same name is returned */
+  $ ASSERT_EQ(table.getColumnIgnoreCase("NAME").getIndex(), 1);
+  $ ASSERT_EQ(table.getColumnIgnoreCase("OTHER").getIndex(), 303);
+
+  $ ASSERT_FALSE(table.getColumn("NAME"));
+  $ ASSERT_FALSE(table.getColumn("column300"));
+  $ ASSERT_FALSE(table.getColumnIgnoreCase("column300"));
+}
+
+TEST(CSVTable, projection) {
+  CSVTable table;
+  CSVError error;
+
+  $ ASSERT_FALSE(table.projectColumns({0}));
+
+  table.addData("Col1,Col2,Col3,Col4\n");
+  $ ASSERT_FALSE(table.projectColumns({4}));
+  $ ASSERT_FALSE(table.projectColumnNames({"Col2", "Col5"}));
+  $ ASSERT_TRUE(table.getColumn("Col1").isProjected());
+
+  $ ASSERT_TRUE(table.projectColumnNames({"Col2", "Col4"}));
+  $ ASSERT_FALSE(table.getColumn("Col1").isProjected());
+  $ ASSERT_TRUE(table.getColumn("Col2").isProjected());
+
+  table.addData("Value1,\"Value\"\"2\",Value3,Value4\n\"Val\nue5\",Value6,\"Value7\",Value8,Value9\n");
+  $ ASSERT_TRUE(table.getError(error));
+  $ ASSERT_EQ(error.message, "Unexpected extra column");
+  $ ASSERT_EQ(error.line, 4);
+  $ ASSERT_FALSE(table.hasError());
+
+  static const char retained[] = "Value10,Value11,Value12,Value13\n";
+  table.addDataRetained(retained, sizeof(retained) - 1, nullptr, nullptr);
+
+  /* Column, which is being parsed, keeps its projection */
+  table.addData("Value14,Val");
+  $ ASSERT_TRUE(table.projectColumns({0, 1}));
+  table.addData("ue15,Value16,Value17\nValue18,Value19,Value20\n");
+
+  table.projectAllColumns();
+  $ ASSERT_TRUE(table.getColumn("Col3").isProjected());
+  table.addData("Value21,Value22,Value23,Value24\n");
+
+  CSVColumn c_col1 = table.getColumn("Col1");
+  CSVColumn c_col2 = table.getColumn("Col2");
+  CSVColumn c_col3 = table.getColumn("Col3");
+  CSVColumn c_col4 = table.getColumn("Col4");
+
+  CSVRow row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_TRUE(row.isEmpty(c_col1));
+  $ ASSERT_EQ(row.getValue(c_col2), "Value\"2");
+  $ ASSERT_TRUE(row.isEmpty(c_col3));
+  $ ASSERT_EQ(row.getValue(c_col4), "Value4");
+
+  row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_TRUE(row.isEmpty(c_col1));
+  $ ASSERT_EQ(row.getValue(c_col2), "Value6");
+  $ ASSERT_TRUE(row.isEmpty(c_col3));
+  $ ASSERT_EQ(row.getValue(c_col4), "Value8");
+
+  row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_TRUE(row.isEmpty(c_col1));
+  $ ASSERT_EQ(row.getValue(c_col2), "Value11");
+  $ ASSERT_EQ(row.getValue(c_col4), "Value13");
+
+  row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_TRUE(row.isEmpty(c_col1));
+  $ ASSERT_EQ(row.getValue(c_col2), "Value15");
+  $ ASSERT_TRUE(row.isEmpty(c_col3));
+  $ ASSERT_TRUE(row.isEmpty(c_col4));
+
+  row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_EQ(row.getValue(c_col1), "Value18");
+  $ ASSERT_EQ(row.getValue(c_col2), "Value19");
+  $ ASSERT_TRUE(row.isEmpty(c_col3));
+
+  row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_EQ(row.getValue(c_col1), "Value21");
+  $ ASSERT_EQ(row.getValue(c_col3), "Value23");
+  $ ASSERT_EQ(row.getValue(c_col4), "Value24");
+
+  $ ASSERT_FALSE(table.nextRow());
+
+  /* Skipped values are NULL */
+  csv_table *c_table = csv_table_create();
+  csv_table_add_data(c_table, "a,b\n");
+  const char *names[] = {"b"};
+  $ ASSERT_TRUE(csv_table_project_column_names(c_table, names, 1));
+  csv_table_add_data(c_table, "1,2\n");
+
+  csv_row *c_row = csv_table_next_row(c_table);
+  $ ASSERT_NE(c_row, nullptr);
+  $ ASSERT_EQ(csv_row_value(c_row, csv_table_column(c_table, 0)), nullptr);
+  $ ASSERT_STREQ(csv_row_value(c_row, csv_table_column(c_table, 1)), "2");
+  csv_row_free(c_row);
+  csv_table_free(c_table);
+}
+
+TEST(CSVTable, batches) {
+  CSVTable table;
+  $ ASSERT_TRUE(table.setBatchSize(3));
+  $ ASSERT_EQ(table.getBatchSize(), 3);
+
+  table.addData("Col1,Col2,Col3\nValue1, Value2 ,\"Val\"\"ue3\"\n\nValue4,Val");
+  $ ASSERT_FALSE(table.setBatchSize(2));
+  $ ASSERT_FALSE(table.nextBatch());
+
+  static const char retained[] = "ue5\nValue6,,Value7\nValue8,Value9,Value10\n";
+  table.addDataRetained(retained, sizeof(retained) - 1, nullptr, nullptr);
+  $ ASSERT_FALSE(table.hasError());
+  $ ASSERT_FALSE(table.hasRow());
+
+  CSVBatch batch = table.nextBatch();
+  $ ASSERT_TRUE(batch);
+  $ ASSERT_EQ(batch.getIndex(), 0);
+  $ ASSERT_EQ(batch.getRowCount(), 3);
+  $ ASSERT_EQ(batch.getColumnCount(), 3);
+
+  CSVBatchColumn c_col1 = batch.getColumn(table.getColumn("Col1"));
+  CSVBatchColumn c_col2 = batch.getColumn(1);
+  CSVBatchColumn c_col3 = batch.getColumn(2);
+
+  $ ASSERT_EQ(vector<string_view>(c_col1.begin(), c_col1.end()), (vector<string_view> {"Value1", "Value4", "Value6"}));
+  $ ASSERT_EQ(vector<string_view>(c_col2.begin(), c_col2.end()), (vector<string_view> {"Value2", "Value5", ""}));
+  $ ASSERT_EQ(c_col3[0], "Val\"ue3");
+  $ ASSERT_EQ(c_col3[1], "");
+  $ ASSERT_EQ(c_col3[2], "Value7");
+
+  $ ASSERT_TRUE(c_col2.isValid(2));
+  $ ASSERT_FALSE(c_col3.isValid(1));
+
+  $ ASSERT_FALSE(table.nextBatch());
+  table.flushBatch();
+
+  batch = table.nextBatch();
+  $ ASSERT_TRUE(batch);
+  $ ASSERT_EQ(batch.getIndex(), 3);
+  $ ASSERT_EQ(batch.getRowCount(), 1);
+  $ ASSERT_EQ(batch.getColumn(2)[0], "Value10");
+  $ ASSERT_FALSE(table.nextBatch());
+
+  /* Nothing to flush */
+  table.flushBatch();
+  $ ASSERT_FALSE(table.nextBatch());
+
+  $ ASSERT_TRUE(table.setBatchSize(0));
+  table.addData("Value11,Value12,Value13\n");
+  CSVRow row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_EQ(row.getIndex(), 4);
+  $ ASSERT_EQ(row.getValue(table.getColumn("Col3")), "Value13");
+
+  /* Raw layout */
+  csv_table *c_table = csv_table_create();
+  csv_table_set_batch_size(c_table, 16);
+  csv_table_add_data(c_table, "a,b\n1,22\n,333\n4444\n");
+  csv_table_flush_batch(c_table);
+
+  csv_batch *c_batch = csv_table_next_batch(c_table);
+  $ ASSERT_NE(c_batch, nullptr);
+  $ ASSERT_EQ(csv_batch_row_count(c_batch), 3);
+  $ ASSERT_EQ(string(csv_batch_column_data(c_batch, 1), csv_batch_column_offsets(c_batch, 1)[3]), "22333");
+  $ ASSERT_EQ(csv_batch_column_offsets(c_batch, 1)[1], 2);
+  $ ASSERT_EQ(csv_batch_column_validity(c_batch, 0)[0], 0b111);
+  $ ASSERT_EQ(csv_batch_column_validity(c_batch, 1)[0], 0b011);
+  $ ASSERT_FALSE(csv_batch_value_valid(c_batch, 1, 2));
+
+  csv_batch_free(c_batch);
+  csv_table_free(c_table);
+}
+
+TEST(CSVTable, column_types) {
+  CSVTable table;
+  CSVError error;
+
+  table.addData("Int,UInt,Double,Bool,Text\n");
+  CSVColumn c_int = table.getColumn("Int");
+  CSVColumn c_uint = table.getColumn("UInt");
+  CSVColumn c_double = table.getColumn("Double");
+  CSVColumn c_bool = table.getColumn("Bool");
+  CSVColumn c_text = table.getColumn("Text");
+
+  $ ASSERT_TRUE(table.setColumnType(c_int, CSV_TYPE_INT16));
+  $ ASSERT_TRUE(table.setColumnType(c_uint, CSV_TYPE_UINT64));
+  $ ASSERT_TRUE(table.setColumnType(c_double, CSV_TYPE_DOUBLE));
+  $ ASSERT_TRUE(table.setColumnType(c_bool, CSV_TYPE_BOOL));
+  $ ASSERT_EQ(c_int.getType(), CSV_TYPE_INT16);
+  $ ASSERT_EQ(c_text.getType(), CSV_TYPE_STRING);
+
+  table.addData("-300, 18446744073709551615 ,2.5,yes,\"text\"\n");
+  table.addData("40000,-1,x,maybe,text\n");
+  table.addData(",,,,\n1,2");
+  $ ASSERT_FALSE(table.setColumnType(c_text, CSV_TYPE_INT8));
+  table.addData(",3,no\n");
+
+  $ ASSERT_TRUE(table.getError(error));
+  $ ASSERT_EQ(error.message, "Value does not match type of column");
+  $ ASSERT_EQ(error.line, 3);
+  $ ASSERT_EQ(error.column, 0);
+  $ ASSERT_TRUE(table.getError(error));
+  $ ASSERT_EQ(error.column, 6);
+  $ ASSERT_TRUE(table.getError(error));
+  $ ASSERT_EQ(error.column, 9);
+  $ ASSERT_TRUE(table.getError(error));
+  $ ASSERT_EQ(error.column, 11);
+  $ ASSERT_FALSE(table.hasError());
+
+  CSVRow row = table.nextRow();
+  $ ASSERT_TRUE(row);
+
+  int16_t i16;
+  int64_t i64;
+  uint64_t u64;
+  double d;
+  float f;
+  $ ASSERT_TRUE(row.getValue(c_int, i16));
+  $ ASSERT_EQ(i16, -300);
+  $ ASSERT_FALSE(row.getValue(c_uint, i64));
+  $ ASSERT_TRUE(row.getValue(c_uint, u64));
+  $ ASSERT_EQ(u64, UINT64_MAX);
+  $ ASSERT_TRUE(row.getValue(c_double, d));
+  $ ASSERT_EQ(d, 2.5);
+  $ ASSERT_TRUE(row.getValue(c_int, f));
+  $ ASSERT_EQ(f, -300.0f);
+  $ ASSERT_FALSE(row.getValue(c_double, i64));
+  $ ASSERT_TRUE(row.getValueBool(c_bool));
+  $ ASSERT_EQ(row.getValue(c_int), "");
+  $ ASSERT_EQ(row.getValue(c_text), "text");
+  $ ASSERT_FALSE(row.isEmpty(c_int));
+
+  row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_TRUE(row.isEmpty(c_int));
+  $ ASSERT_FALSE(row.getValue(c_int, i16));
+  $ ASSERT_FALSE(row.getValue(c_uint, u64));
+  $ ASSERT_FALSE(row.getValue(c_double, d));
+  $ ASSERT_EQ(row.getValueOr(c_bool, true), true);
+
+  row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_TRUE(row.isEmpty(c_int));
+  $ ASSERT_FALSE(row.getValue(c_double, d));
+
+  row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_TRUE(row.getValue(c_int, i64));
+  $ ASSERT_EQ(i64, 1);
+  $ ASSERT_TRUE(row.getValue(c_uint, i64));
+  $ ASSERT_EQ(i64, 2);
+  $ ASSERT_TRUE(row.getValue(c_double, d));
+  $ ASSERT_EQ(d, 3);
+  $ ASSERT_EQ(row.getValueOr(c_bool, true), false);
+
+  bool value;
+  $ ASSERT_TRUE(csv_parse_bool("Yes", 3, &value));
+  $ ASSERT_TRUE(value);
+  $ ASSERT_TRUE(csv_parse_bool("never", 5, &value));
+  $ ASSERT_FALSE(value);
+  $ ASSERT_FALSE(csv_parse_bool("yes ", 4, &value));
+}
+
+TEST(CSVTable, column_types_fixed) {
+  CSVTable table;
+  table.addData("a,b\n123,x\n");
+  CSVColumn c_a = table.getColumn("a");
+
+  /* Values of parsed rows are stored according to the types, so they can not be changed anymore */
+  $ ASSERT_FALSE(table.setColumnType(c_a, CSV_TYPE_INT32));
+  table.addData("456,y\n");
+  $ ASSERT_FALSE(table.setColumnType(c_a, CSV_TYPE_STRING));
+  $ ASSERT_EQ(c_a.getType(), CSV_TYPE_STRING);
+
+  int32_t value;
+  CSVRow row = table.nextRow();
+  $ ASSERT_EQ(row.getValue(c_a), "123");
+  row = table.nextRow();
+  $ ASSERT_EQ(row.getValue(c_a), "456");
+  $ ASSERT_TRUE(row.getValue(c_a, value));
+  $ ASSERT_EQ(value, 456);
+}
+
+TEST(CSVTable, row_callback) {
+  static const string chunks[] = {
+    "Col1,Col2\nValue1,Value2\nValue3,",
+    "Value4\n\nValue5,Value6\n",
+  };
+
+  size_t released = 0;
+  auto release = [](const char *, size_t, void *data) {
+    ++*reinterpret_cast<size_t *>(data);
+  };
+
+  CSVTable table;
+  vector<pair<size_t, string>> rows;
+  table.setRowCallback([&](const CSVRow &row) {
+    rows.emplace_back(row.getIndex(), row.getValue(table.getColumn("Col2")));
+  });
+
+  table.addDataRetained(chunks[0].data(), chunks[0].size(), release, &released);
+  $ ASSERT_EQ(rows.size(), 1);
+
+  /* The first chunk is referenced by the value of the current row */
+  $ ASSERT_EQ(released, 0);
+  table.addDataRetained(chunks[1].data(), chunks[1].size(), release, &released);
+  $ ASSERT_EQ(released, 2);
+
+  $ ASSERT_FALSE(table.hasRow());
+  $ ASSERT_EQ(rows, (vector<pair<size_t, string>> {{0, "Value2"}, {1, "Value4"}, {2, "Value6"}}));
+
+  table.setRowCallback(nullptr);
+  table.addData("Value7,Value8\n");
+  $ ASSERT_EQ(rows.size(), 3);
+  $ ASSERT_EQ(table.nextRow().getIndex(), 3);
+
+  /* Memory of row is reused */
+  csv_table *c_table = csv_table_create();
+  vector<const csv_row *> c_rows;
+  csv_table_set_row_callback(c_table, [](const csv_row *row, void *data) {
+    reinterpret_cast<vector<const csv_row *> *>(data)->push_back(row);
+  }, &c_rows);
+  csv_table_add_data(c_table, "a,b\n1,2\n3,4\n");
+  $ ASSERT_EQ(c_rows.size(), 2);
+  $ ASSERT_EQ(c_rows[0], c_rows[1]);
+  csv_table_free(c_table);
+}
+
+TEST(CSVTable, bounded_queue) {
+  CSVTable table;
+  table.setMaxQueuedRows(2);
+  $ ASSERT_EQ(table.getMaxQueuedRows(), 2);
+
+  const string data = "Col1,Col2\n1,a\r\n2,\"b\"\n3,c\n\n4\n5,e";
+  size_t consumed = table.feed(data);
+  $ ASSERT_EQ(table.availableRows(), 2);
+  $ ASSERT_LT(consumed, data.size());
+
+  /* Full queue accepts nothing */
+  $ ASSERT_EQ(table.feed(data.substr(consumed)), 0);
+
+  vector<string> values;
+  while (consumed < data.size()) {
+    CSVRow row;
+    while ((row = table.nextRow())) {
+      $ ASSERT_EQ(row.getIndex(), values.size());
+      values.push_back(row.getValue(table.getColumn("Col1")));
+    }
+
+    size_t count = table.feed(data.data() + consumed, data.size() - consumed);
+    $ ASSERT_LE(table.availableRows(), 2);
+    consumed += count;
+  }
+  table.addData("\n");
+
+  CSVRow row;
+  while ((row = table.nextRow())) {
+    values.push_back(row.getValue(table.getColumn("Col1")));
+  }
+
+  $ ASSERT_EQ(values, (vector<string> {"1", "2", "3", "4", "5"}));
+
+  CSVError error;
+  table.addData("6,f,g\n");
+  $ ASSERT_TRUE(table.getError(error));
+  $ ASSERT_EQ(error.line, 8);
+}
+
+TEST(CSVTable, rows_range) {
+  CSVTable table;
+  table.addData("Col1,Col2\n1,a\n2,b\n");
+
+  vector<string> values;
+  for (const CSVRow &row : table.rows()) {
+    values.push_back(row.getValue(table.getColumn("Col1")));
+  }
+  $ ASSERT_EQ(values, (vector<string> {"1", "2"}));
+  $ ASSERT_FALSE(table.hasRow());
+
+  /* Data is fed while iterating */
+  size_t count = 0;
+  CSVTable players;
+  for (const CSVRow &row : players.rows(mlb_players)) {
+    $ ASSERT_EQ(row.getIndex(), count);
+    ++count;
+  }
+  $ ASSERT_GT(count, 1000);
+  $ ASSERT_FALSE(print_errors(players));
+
+  /* Parsing stops with iteration, the rest of data is not consumed */
+  string data = "Id\n";
+  for (size_t i = 0; data.size() < 4 * CSVRowRange::feedLength; ++i) {
+    data += to_string(i) + "\n";
+  }
+
+  CSVTable partial;
+  partial.setMaxQueuedRows(16);
+  for (const CSVRow &row : partial.rows(data)) {
+    if (row.getIndex() == 100) {
+      break;
+    }
+  }
+  $ ASSERT_LE(partial.availableRows(), 16);
+
+#if __cplusplus >= 202002L
+  CSVTable ranged;
+  vector<string> even;
+  auto view = ranged.rows(data)
+    | views::filter([](const CSVRow &row) { return row.getIndex() % 2 == 0; })
+    | views::take(3);
+  for (const CSVRow &row : view) {
+    even.emplace_back(row.getView(ranged.getColumn("Id")));
+  }
+  $ ASSERT_EQ(even, (vector<string> {"0", "2", "4"}));
+  /* Only the first part of data is parsed */
+  $ ASSERT_LT(ranged.availableRows(), count_if(data.begin(), data.end(), [](char c) { return c == '\n'; }) / 2);
+#endif
+}
+
+TEST(CSVTable, row_callback_move) {
+  vector<size_t> indices;
+  auto callback = [&](const CSVRow &row) {
+    indices.push_back(row.getIndex());
+  };
+
+  /* Callback belongs to the table it is moved to */
+  unique_ptr<CSVTable> source {new CSVTable};
+  source->setRowCallback(callback);
+  source->addData("a\n1\n");
+  CSVTable table = move(*source);
+  source.reset();
+  table.addData("2\n");
+  $ ASSERT_EQ(indices, (vector<size_t> {0, 1}));
+
+  unique_ptr<CSVParser> parser_source {new CSVParser};
+  parser_source->setRowCallback(callback);
+  parser_source->addData("a\n1\n");
+  CSVParser parser = move(*parser_source);
+  parser_source.reset();
+  parser.addData("2\n3\n");
+  $ ASSERT_EQ(indices, (vector<size_t> {0, 1, 0, 1, 2}));
+
+  parser.setRowCallback(nullptr);
+  parser.addData("4\n");
+  $ ASSERT_EQ(indices.size(), 5);
+  $ ASSERT_TRUE(parser.hasRow());
+}
+
+TEST(CSVTable, channel) {
+  CSVTable table;
+  CSVChannel channel = table.getChannel();
+  $ ASSERT_TRUE(channel);
+  $ ASSERT_FALSE(channel.tryNextRow());
+
+  vector<string> chunks;
+  for (size_t i = 0; i < 200; ++i) {
+    string chunk;
+    for (size_t j = 0; j < 50; ++j) {
+      chunk += to_string(i * 50 + j) + ",\"v" + to_string(j) + "\"\n";
+    }
+    chunks.push_back(move(chunk));
+  }
+
+  atomic<size_t> released {0};
+  thread producer([&] {
+    table.addData("Id,Value\n");
+    for (const string &chunk : chunks) {
+      table.addDataRetained(chunk.data(), chunk.size(), [](const char *, size_t, void *data) {
+        ++*reinterpret_cast<atomic<size_t> *>(data);
+      }, &released);
+    }
+    channel.close();
+  });
+
+  size_t count = 0;
+  CSVRow row;
+  while ((row = channel.nextRow())) {
+    $ ASSERT_EQ(row.getIndex(), count);
+    $ ASSERT_EQ(row.getValue(table.getColumn("Id")), to_string(count));
+    $ ASSERT_EQ(row.getValue(table.getColumn("Value")), "v" + to_string(count % 50));
+    ++count;
+  }
+  producer.join();
+
+  $ ASSERT_EQ(count, 200 * 50);
+  $ ASSERT_EQ(released, chunks.size());
+  $ ASSERT_FALSE(table.hasRow());
+  $ ASSERT_FALSE(channel.nextRow());
+}
+
+TEST(CSVTable, channel_row_callback) {
+  static const string chunks[] = {
+    "Col1,Col2\nValue1,Value2\nValue3,",
+    "Value4\nValue5,Value6\n",
+  };
+
+  size_t released = 0;
+  auto release = [](const char *, size_t, void *data) {
+    ++*reinterpret_cast<size_t *>(data);
+  };
+
+  /* Rows passed to the callback are recycled by the parser, not through the channel */
+  CSVTable table;
+  CSVChannel channel = table.getChannel();
+  vector<string> values;
+  table.setRowCallback([&](const CSVRow &row) {
+    values.push_back(row.getValue(table.getColumn("Col1")) + row.getValue(table.getColumn("Col2")));
+  });
+
+  table.addDataRetained(chunks[0].data(), chunks[0].size(), release, &released);
+  $ ASSERT_EQ(released, 0);
+  table.addDataRetained(chunks[1].data(), chunks[1].size(), release, &released);
+  $ ASSERT_EQ(released, 2);
+  $ ASSERT_EQ(values, vector<string>({"Value1Value2", "Value3Value4", "Value5Value6"}));
+  $ ASSERT_FALSE(channel.tryNextRow());
+}
+
+TEST(CSVTable, parallel) {
+  struct Result {
+    const csv_table *table;
+    vector<vector<string>> rows;
+    vector<size_t> indices;
+    vector<string> errors;
+    size_t released = 0;
+
+    void add(const csv_row *row) {
+      vector<string> values;
+      for (size_t i = 0; i < csv_table_column_count(table); ++i) {
+        csv_column *column = csv_table_column(table, i);
+        values.emplace_back(csv_row_value(row, column), csv_row_value_length(row, column));
+      }
+      rows.push_back(move(values));
+      indices.push_back(csv_row_index(row));
+    }
+  };
+
+  auto parse = [](const string &data, size_t threads, bool retained, bool callback) {
+    Result result;
+
+    csv_table *table = csv_table_create();
+    result.table = table;
+    csv_table_set_thread_count(table, threads);
+    if (callback) {
+      csv_table_set_row_callback(table, [](const csv_row *row, void *data) {
+        reinterpret_cast<Result *>(data)->add(row);
+      }, &result);
+    }
+    csv_table_set_error_callback(table, [](const char *error, size_t line, size_t column, void *data) {
+      reinterpret_cast<Result *>(data)->errors.push_back(
+        to_string(line) + ":" + to_string(column) + ": " + error
+      );
+    }, &result);
+
+    /* Data is fed in two parts, the first one ends in the middle of a row */
+    size_t split = data.size() / 3 * 2 + 7;
+    for (size_t begin = 0; begin < data.size(); begin = split, split = data.size()) {
+      if (retained) {
+        csv_table_add_data_retained(table, data.data() + begin, split - begin, [](const char *, size_t, void *data) {
+          ++reinterpret_cast<Result *>(data)->released;
+        }, &result);
+      } else {
+        csv_table_add_data_length(table, data.data() + begin, split - begin);
+      }
+    }
+    csv_table_add_data(table, "\n");
+
+    csv_row *row;
+    while ((row = csv_table_next_row(table)) != nullptr) {
+      result.add(row);
+      csv_row_free(row);
+    }
+
+    csv_table_free(table);
+    return result;
+  };
+
+  string data = "Id,Text,Number\n";
+  for (size_t i = 0; data.size() < 8 * LIBCSV_PARALLEL_MIN_LENGTH; ++i) {
+    data += to_string(i);
+    switch (i % 5) {
+    case 0:
+      data += ",\"multi\nline,\n" + to_string(i) + "\"\"\n\",1.5\n";
+      break;
+    case 1:
+      data += ",\"quoted\" x," + to_string(i) + "\n";
+      break;
+    case 2:
+      data += ",plain,1,extra\r\n";
+      break;
+    default:
+      data += ",text " + to_string(i) + "," + to_string(i * 7) + "\n";
+      break;
+    }
+  }
+
+  /* Escaped column covering most of the data, so ranges of workers do not start at rows */
+  string escaped = "Id,Text\n1,\"";
+  for (size_t i = 0; escaped.size() < 4 * LIBCSV_PARALLEL_MIN_LENGTH; ++i) {
+    escaped += "line\n";
+  }
+  escaped += "\"\n2,last\n";
+
+  /* Quote inside of unescaped column misleads the count, so ranges end inside of escaped columns and are rejected */
+  string stray = "Id,Text\n0,5\" inch\n";
+  for (size_t i = 1; stray.size() < 4 * LIBCSV_PARALLEL_MIN_LENGTH; ++i) {
+    stray += to_string(i) + (i % 100 == 0 ? ",\"multi\nline\"\n" : ",text\n");
+  }
+
+  for (const string *input : {&data, &escaped, &stray}) {
+    for (bool retained : {false, true}) {
+      Result serial = parse(*input, 1, retained, false);
+      Result parallel = parse(*input, 4, retained, false);
+      Result callback = parse(*input, 4, retained, true);
+
+      $ ASSERT_FALSE(serial.rows.empty());
+      $ ASSERT_EQ(serial.rows, parallel.rows);
+      $ ASSERT_EQ(serial.indices, parallel.indices);
+      $ ASSERT_EQ(serial.errors, parallel.errors);
+      $ ASSERT_EQ(serial.rows, callback.rows);
+      $ ASSERT_EQ(serial.indices, callback.indices);
+
+      /* Both parts are released, also when ranges of workers are rejected */
+      $ ASSERT_EQ(serial.released, retained ? 2 : 0);
+      $ ASSERT_EQ(parallel.released, serial.released);
+      $ ASSERT_EQ(callback.released, serial.released);
+
+      for (size_t i = 0; i < parallel.indices.size(); ++i) {
+        $ ASSERT_EQ(parallel.indices[i], i);
+      }
+    }
+  }
+
+  $ ASSERT_EQ(parse(data, 4, false, false).errors.size() % 2, 0);
+}
+
+TEST(CSVWriter, round_trip) {
+  const vector<vector<string>> rows = {
+    {"Text", "Other"},
+    {"plain", ""},
+    {"comma, inside", "quote \"inside\""},
+    {"multi\nline", "carriage\rreturn"},
+    {" leading", "trailing\t"},
+    {"\"", string(200, 'x') + "," + string(100, '"')},
+    {"", ""},
+  };
+
+  for (char separator : {',', ';', '|'}) {
+    string output;
+    {
+      CSVWriter writer([&](const char *data, size_t length) {
+        output.append(data, length);
+        return true;
+      });
+      writer.setSeparator(separator);
+      $ ASSERT_EQ(writer.getSeparator(), separator);
+
+      for (const auto &row : rows) {
+        for (const string &value : row) {
+          writer.write(value);
+        }
+        writer.endRow();
+      }
+
+      /* Single empty value is not an empty line */
+      writer.write("");
+      writer.endRow();
+      $ ASSERT_TRUE(writer.flush());
+    }
+
+    CSVTable table;
+    table.setSeparator(separator);
+    table.addData(output);
+    $ ASSERT_FALSE(print_errors(table));
+
+    for (size_t i = 1; i < rows.size(); ++i) {
+      CSVRow row = table.nextRow();
+      $ ASSERT_TRUE(row);
+      $ ASSERT_EQ(row.getValue(table.getColumn("Text")), rows[i][0]);
+      $ ASSERT_EQ(row.getValue(table.getColumn("Other")), rows[i][1]);
+    }
+
+    CSVRow row = table.nextRow();
+    $ ASSERT_TRUE(row);
+    $ ASSERT_TRUE(row.isEmpty(table.getColumn("Text")));
+    $ ASSERT_FALSE(table.hasRow());
+  }
+
+  /* Plain values are not quoted */
+  string output;
+  {
+    CSVWriter writer([&](const char *data, size_t length) {
+      output.append(data, length);
+      return true;
+    });
+    writer.write("a b");
+    writer.write(int64_t {-42});
+    writer.write(1.5);
+    writer.write(true);
+    writer.endRow();
+  }
+  $ ASSERT_EQ(output, "a b,-42,1.5,true\n");
+}
+
+TEST(CSVWriter, dialect) {
+  const vector<vector<string>> rows = {
+    {"Te'xt", "Other, one"},
+    {"'quoted'", "\"double\""},
+    {"comma, inside", "semicolon; inside"},
+    {" leading", "multi\nline"},
+    {"carriage\rreturn", ""},
+  };
+
+  for (const csv_dialect &dialect : {csv_dialect {',', '\'', true, true}, csv_dialect {';', '\'', false, false}}) {
+    CSVTable source;
+    $ ASSERT_TRUE(source.setDialect(dialect));
+    for (const auto &row : rows) {
+      for (size_t i = 0; i < row.size(); ++i) {
+        string value = row[i];
+        for (size_t quote = 0; (quote = value.find('\'', quote)) != string::npos; quote += 2) {
+          value.insert(quote, 1, '\'');
+        }
+        source.addData("'" + value + "'" + (i + 1 == row.size() ? "\n" : string(1, dialect.separator)));
+      }
+    }
+    $ ASSERT_FALSE(print_errors(source));
+
+    /* Header and rows of table are written in its dialect */
+    string output;
+    {
+      CSVWriter writer([&](const char *data, size_t length) {
+        output.append(data, length);
+        return true;
+      });
+      $ ASSERT_TRUE(writer.setDialect(source.getDialect()));
+      $ ASSERT_EQ(writer.getDialect().quote, '\'');
+      $ ASSERT_FALSE(writer.setDialect({',', ',', true, true}));
+
+      writer.writeHeader(source);
+      while (CSVRow row = source.nextRow()) {
+        writer.writeRow(row);
+      }
+    }
+
+    CSVTable table;
+    $ ASSERT_TRUE(table.setDialect(dialect));
+    table.addData(output);
+    $ ASSERT_FALSE(print_errors(table));
+    CSVColumn c_first = table.getColumn(rows[0][0].c_str());
+    CSVColumn c_second = table.getColumn(rows[0][1].c_str());
+    $ ASSERT_TRUE(c_first);
+    $ ASSERT_TRUE(c_second);
+
+    for (size_t i = 1; i < rows.size(); ++i) {
+      CSVRow row = table.nextRow();
+      $ ASSERT_TRUE(row);
+      $ ASSERT_EQ(row.getValue(c_first), rows[i][0]);
+      $ ASSERT_EQ(row.getValue(c_second), rows[i][1]);
+    }
+    $ ASSERT_FALSE(table.hasRow());
+  }
+}
+
+TEST(CSVWriter, numbers) {
+  mt19937_64 random {42};
+  vector<int64_t> integers = {0, 1, -1, 9, 10, 99, 100, INT64_MIN, INT64_MAX};
+  vector<double> doubles = {0.0, -0.0, 0.1, 1.5, -2.25, 1e22, 1e300, 5e-324, 123456.789, INFINITY, -INFINITY};
+  vector<float> floats = {0.0f, 0.1f, 3.14159f, 1e30f, -1e-30f, 16777217.0f};
+  for (size_t i = 0; i < 2000; ++i) {
+    uint64_t bits = random();
+    double d;
+    float f;
+    memcpy(&d, &bits, sizeof(d));
+    memcpy(&f, &bits, sizeof(f));
+    integers.push_back(static_cast<int64_t>(bits) >> (i % 64));
+    doubles.push_back(isnan(d) ? static_cast<double>(bits % 100000) / 1000 : d);
+    floats.push_back(isnan(f) ? static_cast<float>(bits % 1000) / 100 : f);
+  }
+
+  string output;
+  {
+    CSVWriter writer([&](const char *data, size_t length) {
+      output.append(data, length);
+      return true;
+    });
+    writer.write("Integer");
+    writer.write("Unsigned");
+    writer.write("Double");
+    writer.write("Float");
+    writer.write("Nan");
+    writer.endRow();
+
+    for (size_t i = 0; i < integers.size(); ++i) {
+      writer.write(integers[i]);
+      writer.write(static_cast<uint64_t>(integers[i]));
+      writer.write(doubles[i % doubles.size()]);
+      writer.write(floats[i % floats.size()]);
+      writer.write(NAN);
+      writer.endRow();
+    }
+  }
+
+  CSVTable table;
+  table.addData(output);
+  $ ASSERT_FALSE(print_errors(table));
+
+  for (size_t i = 0; i < integers.size(); ++i) {
+    CSVRow row = table.nextRow();
+    int64_t integer;
+    uint64_t unsigned_integer;
+    double d;
+    float f, nan;
+
+    $ ASSERT_TRUE(row.getValue(table.getColumn("Integer"), integer));
+    $ ASSERT_EQ(integer, integers[i]);
+    $ ASSERT_TRUE(row.getValue(table.getColumn("Unsigned"), unsigned_integer));
+    $ ASSERT_EQ(unsigned_integer, static_cast<uint64_t>(integers[i]));
+    $ ASSERT_TRUE(row.getValue(table.getColumn("Double"), d));
+    $ ASSERT_EQ(memcmp(&d, &doubles[i % doubles.size()], sizeof(d)), 0) << row.getValue(table.getColumn("Double"));
+    $ ASSERT_TRUE(row.getValue(table.getColumn("Float"), f));
+    $ ASSERT_EQ(memcmp(&f, &floats[i % floats.size()], sizeof(f)), 0) << row.getValue(table.getColumn("Float"));
+    $ ASSERT_TRUE(row.getValue(table.getColumn("Nan"), nan));
+    $ ASSERT_TRUE(isnan(nan));
+  }
+
+  /* Short representations */
+  $ ASSERT_NE(output.find("\n0,0,0,0,nan\n"), string::npos);
+  $ ASSERT_NE(output.find(",-0,"), string::npos);
+  $ ASSERT_NE(output.find(",123456.789,"), string::npos);
+}
+
+TEST(CSVWriter, rows) {
+  const string data = "Name,Count,Ratio,Flag\n\"a, b\",1,0.5,yes\nc,,-1e-3,no\n";
+
+  CSVTable table;
+  table.addData("Name,Count,Ratio,Flag\n");
+  $ ASSERT_TRUE(table.setColumnType(table.getColumn("Count"), CSV_TYPE_INT32));
+  $ ASSERT_TRUE(table.setColumnType(table.getColumn("Ratio"), CSV_TYPE_DOUBLE));
+  $ ASSERT_TRUE(table.setColumnType(table.getColumn("Flag"), CSV_TYPE_BOOL));
+  table.addData(data.substr(22));
+
+  FILE *file = tmpfile();
+  $ ASSERT_NE(file, nullptr);
+  {
+    CSVWriter writer(file);
+    writer.writeHeader(table);
+
+    CSVRow row;
+    while ((row = table.nextRow())) {
+      writer.writeRow(row);
+    }
+  }
+
+  string output(ftell(file), '\0');
+  rewind(file);
+  $ ASSERT_EQ(fread(&output[0], 1, output.size(), file), output.size());
+  fclose(file);
+
+  $ ASSERT_EQ(output, "Name,Count,Ratio,Flag\n\"a, b\",1,0.5,true\nc,,-0.001,false\n");
+}
+
+TEST(CSVTable, stats) {
+  CSVTable table;
+  table.addData("a,b\n");
+  table.setColumnType(table.getColumn("a"), CSV_TYPE_INT8);
+  table.addData("1,\"x\"\n2,y\n");
+  table.addData("1000,\"" + string(300, 'v') + "\"\n");
+
+  csv_stats stats;
+  if (!table.getStats(stats)) {
+    $ ASSERT_EQ(stats.bytes_consumed, 0);
+    $ ASSERT_EQ(stats.rows_emitted, 0);
+    return;
+  }
+
+  $ ASSERT_EQ(stats.bytes_consumed, 14 + 308);
+  $ ASSERT_EQ(stats.rows_emitted, 3);
+  $ ASSERT_EQ(stats.fields_emitted, 6);
+  $ ASSERT_EQ(stats.quoted_fields, 2);
+  $ ASSERT_EQ(stats.conversion_failures, 1);
+  $ ASSERT_EQ(stats.queue_peak, 3);
+  $ ASSERT_GE(stats.buffer_regrowths, 2);
+  $ ASSERT_GT(stats.bytes_allocated, 0);
+
+  while (table.nextRow()) {
+  }
+  for (size_t i = 0; i < 10; ++i) {
+    table.addData("1,x\n");
+  }
+
+  $ ASSERT_TRUE(table.getStats(stats));
+  $ ASSERT_EQ(stats.rows_emitted, 13);
+  $ ASSERT_EQ(stats.queue_peak, 10);
+  $ ASSERT_GE(stats.queue_resizes, 2);
+}
+
+TEST(CSVTable, dialect) {
+  CSVTable table;
+  csv_dialect dialect = table.getDialect();
+  $ ASSERT_EQ(dialect.separator, ',');
+  $ ASSERT_EQ(dialect.quote, '"');
+  $ ASSERT_TRUE(dialect.trim);
+  $ ASSERT_TRUE(dialect.cr_newline);
+
+  $ ASSERT_FALSE(table.setDialect({',', ',', true, true}));
+  $ ASSERT_FALSE(table.setDialect({'\n', '"', true, true}));
+  $ ASSERT_FALSE(table.setDialect({'\r', '"', true, true}));
+  $ ASSERT_TRUE(table.setDialect({'\r', '\'', false, false}));
+  $ ASSERT_TRUE(table.setDialect({';', '\'', false, false}));
+  $ ASSERT_EQ(table.getSeparator(), ';');
+
+  table.addData("A;B\n'x;''y''';  z \r\n'multi\nline';\r\n");
+  $ ASSERT_FALSE(print_errors(table));
+
+  CSVRow row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_EQ(row.getValue(table.getColumn("A")), "x;'y'");
+  $ ASSERT_EQ(row.getValue(table.getColumn("B")), "  z \r");
+
+  row = table.nextRow();
+  $ ASSERT_TRUE(row);
+  $ ASSERT_EQ(row.getValue(table.getColumn("A")), "multi\nline");
+  $ ASSERT_EQ(row.getValue(table.getColumn("B")), "\r");
+}
+
+TEST(BasicParser, dialects) {
+  TSVParser tsv;
+  $ ASSERT_EQ(tsv.getSeparator(), '\t');
+  $ ASSERT_FALSE(tsv.getDialect().trim);
+
+  tsv.addData("A\tB\n a\t\n\"x\ty\"\t b \n");
+  $ ASSERT_FALSE(print_errors(tsv));
+
+  CSVRow row = tsv.nextRow();
+  $ ASSERT_EQ(row.getValue(tsv.getColumn("A")), " a");
+  $ ASSERT_TRUE(row.isEmpty(tsv.getColumn("B")));
+
+  row = tsv.nextRow();
+  $ ASSERT_EQ(row.getValue(tsv.getColumn("A")), "x\ty");
+  $ ASSERT_EQ(row.getValue(tsv.getColumn("B")), " b ");
+
+  /* Default dialect has its own tokenizer, the result must be the same */
+  string piped = mlb_players;
+  replace(piped.begin(), piped.end(), ',', '|');
+
+  CSVParser csv;
+  BasicParser<Dialect<'|'>> pipe;
+  csv.addData(mlb_players);
+  pipe.addData(piped);
+  $ ASSERT_FALSE(print_errors(csv));
+  $ ASSERT_FALSE(print_errors(pipe));
+
+  size_t count = 0;
+  CSVRow a, b;
+  while ((a = csv.nextRow())) {
+    b = pipe.nextRow();
+    $ ASSERT_TRUE(b);
+    $ ASSERT_EQ(a.getValue(csv.getColumn("Name")), b.getValue(pipe.getColumn("Name")));
+    $ ASSERT_EQ(a.getValue(csv.getColumn("Age")), b.getValue(pipe.getColumn("Age")));
+    ++count;
+  }
+  $ ASSERT_FALSE(pipe.hasRow());
+  $ ASSERT_GT(count, 1000);
+}
+
 TEST(CSVTable, free_nullptr) {
   $ ASSERT_NO_FATAL_FAILURE(csv_table_free(nullptr));
 }
@@ -612,6 +1809,549 @@ TEST(CSVRow, free_nullptr) {
 }
 
 
+TEST(Parsers, integers) {
+  int64_t i;
+  uint64_t u;
+
+  $ ASSERT_TRUE(csv_parse_int64("0", 1, &i));
+  $ ASSERT_EQ(i, 0);
+  $ ASSERT_TRUE(csv_parse_int64("-0", 2, &i));
+  $ ASSERT_EQ(i, 0);
+  $ ASSERT_TRUE(csv_parse_int64(" +42", 4, &i));
+  $ ASSERT_EQ(i, 42);
+  $ ASSERT_TRUE(csv_parse_int64("123456789", 9, &i));
+  $ ASSERT_EQ(i, 123456789);
+  $ ASSERT_TRUE(csv_parse_int64("-1234567890123456", 17, &i));
+  $ ASSERT_EQ(i, -1234567890123456);
+  $ ASSERT_TRUE(csv_parse_int64("9223372036854775807", 19, &i));
+  $ ASSERT_EQ(i, INT64_MAX);
+  $ ASSERT_TRUE(csv_parse_int64("-9223372036854775808", 20, &i));
+  $ ASSERT_EQ(i, INT64_MIN);
+  $ ASSERT_TRUE(csv_parse_int64("000000000000000000000001", 24, &i));
+  $ ASSERT_EQ(i, 1);
+
+  /* Only given length is parsed */
+  $ ASSERT_TRUE(csv_parse_int64("12345678901", 3, &i));
+  $ ASSERT_EQ(i, 123);
+
+  $ ASSERT_FALSE(csv_parse_int64("", 0, &i));
+  $ ASSERT_FALSE(csv_parse_int64("-", 1, &i));
+  $ ASSERT_FALSE(csv_parse_int64("1 ", 2, &i));
+  $ ASSERT_FALSE(csv_parse_int64("1234567a", 8, &i));
+  $ ASSERT_FALSE(csv_parse_int64("12345678123456a8", 16, &i));
+  $ ASSERT_FALSE(csv_parse_int64("9223372036854775808", 19, &i));
+  $ ASSERT_FALSE(csv_parse_int64("-9223372036854775809", 20, &i));
+
+  $ ASSERT_TRUE(csv_parse_uint64("18446744073709551615", 20, &u));
+  $ ASSERT_EQ(u, UINT64_MAX);
+  $ ASSERT_TRUE(csv_parse_uint64("+7", 2, &u));
+  $ ASSERT_EQ(u, 7);
+  $ ASSERT_FALSE(csv_parse_uint64("18446744073709551616", 20, &u));
+  $ ASSERT_FALSE(csv_parse_uint64("99999999999999999999", 20, &u));
+  $ ASSERT_FALSE(csv_parse_uint64("-1", 2, &u));
+}
+
+TEST(Parsers, floating_point) {
+  double d;
+  float f;
+
+  $ ASSERT_TRUE(csv_parse_double("3.1415", 6, &d));
+  $ ASSERT_EQ(d, 3.1415);
+  $ ASSERT_TRUE(csv_parse_double(" -16e5", 6, &d));
+  $ ASSERT_EQ(d, -16e5);
+  $ ASSERT_TRUE(csv_parse_double(".5", 2, &d));
+  $ ASSERT_EQ(d, 0.5);
+  $ ASSERT_TRUE(csv_parse_double("5.", 2, &d));
+  $ ASSERT_EQ(d, 5.0);
+  $ ASSERT_TRUE(csv_parse_double("9007199254740993", 16, &d));
+  $ ASSERT_EQ(d, 9007199254740992.0);
+  $ ASSERT_TRUE(csv_parse_double("2.2250738585072011e-308", 23, &d));
+  $ ASSERT_EQ(d, 2.2250738585072011e-308);
+  $ ASSERT_TRUE(csv_parse_double("4.9406564584124654e-324", 23, &d));
+  $ ASSERT_EQ(d, 4.9406564584124654e-324);
+  $ ASSERT_TRUE(csv_parse_double("1e-400", 6, &d));
+  $ ASSERT_EQ(d, 0.0);
+  $ ASSERT_TRUE(csv_parse_double("1e400", 5, &d));
+  $ ASSERT_EQ(d, HUGE_VAL);
+  $ ASSERT_TRUE(csv_parse_double("-Infinity", 9, &d));
+  $ ASSERT_EQ(d, -HUGE_VAL);
+  $ ASSERT_TRUE(csv_parse_double("nan", 3, &d));
+  $ ASSERT_NE(d, d);
+
+  /* More digits than fit into 64 bits */
+  static const char long_value[] = "0.1000000000000000055511151231257827021181583404541015625";
+  $ ASSERT_TRUE(csv_parse_double(long_value, sizeof(long_value) - 1, &d));
+  $ ASSERT_EQ(d, 0.1);
+  static const char halfway[] = "9007199254740993.00000000000000000000000000001";
+  $ ASSERT_TRUE(csv_parse_double(halfway, sizeof(halfway) - 1, &d));
+  $ ASSERT_EQ(d, 9007199254740994.0);
+
+  /* Only given length is parsed */
+  $ ASSERT_TRUE(csv_parse_double("1.25e3", 4, &d));
+  $ ASSERT_EQ(d, 1.25);
+
+  $ ASSERT_FALSE(csv_parse_double("", 0, &d));
+  $ ASSERT_FALSE(csv_parse_double(".", 1, &d));
+  $ ASSERT_FALSE(csv_parse_double("1e", 2, &d));
+  $ ASSERT_FALSE(csv_parse_double("1,5", 3, &d));
+  $ ASSERT_FALSE(csv_parse_double("5.5.5", 5, &d));
+  $ ASSERT_FALSE(csv_parse_double("1.0 ", 4, &d));
+
+  $ ASSERT_TRUE(csv_parse_float("13.5", 4, &f));
+  $ ASSERT_EQ(f, 13.5f);
+  $ ASSERT_TRUE(csv_parse_float("3.4028235e38", 12, &f));
+  $ ASSERT_EQ(f, 3.4028235e38f);
+  $ ASSERT_TRUE(csv_parse_float("1.00000005960464477539062500001", 31, &f));
+  $ ASSERT_EQ(f, 1.00000012f);
+  $ ASSERT_TRUE(csv_parse_float("1e-46", 5, &f));
+  $ ASSERT_EQ(f, 0.0f);
+  $ ASSERT_FALSE(csv_parse_float("-3e", 3, &f));
+}
+
+TEST(CSVRow, move_only) {
+  $ ASSERT_FALSE(is_copy_constructible<CSVRow>::value);
+  $ ASSERT_TRUE(is_nothrow_move_constructible<CSVRow>::value);
+
+  CSVTable table;
+  table.addData(mlb_players);
+  CSVColumn c_name = table.getColumn("Name");
+  CSVColumn c_team = table.getColumn("Team");
+
+  vector<CSVRow> rows;
+  while (table.hasRow()) {
+    rows.push_back(table.nextRow());
+  }
+  $ ASSERT_GT(rows.size(), 1000);
+
+  for (const CSVRow &row : rows) {
+    $ ASSERT_EQ(row.getView(c_name), row.getValue(c_name));
+    $ ASSERT_FALSE(row.getView(c_team).empty());
+  }
+
+  CSVRow row = move(rows[0]);
+  $ ASSERT_FALSE(rows[0]);
+  $ ASSERT_EQ(row.getView(c_name), "Adam Donachie");
+  $ ASSERT_EQ(row.getIndex(), 0);
+
+  row = move(rows[1]);
+  $ ASSERT_EQ(row.getIndex(), 1);
+  rows.clear();
+  $ ASSERT_EQ(row.getView(c_team), "BAL");
+
+  /* Missing value */
+  table.addData("\"Only name\"\n");
+  row = table.nextRow();
+  $ ASSERT_TRUE(row.getView(c_team).empty());
+}
+
+TEST(CSVRow, integer_range) {
+  CSVTable table;
+  table.addData("a,b,c\n128,-129,65536\n");
+
+  CSVRow row = table.nextRow();
+  $ ASSERT_TRUE(row);
+
+  int8_t i8;
+  uint8_t u8;
+  int16_t i16;
+  uint16_t u16;
+  $ ASSERT_FALSE(row.getValue(table.getColumn("a"), i8));
+  $ ASSERT_TRUE(row.getValue(table.getColumn("a"), u8));
+  $ ASSERT_EQ(u8, 128);
+  $ ASSERT_FALSE(row.getValue(table.getColumn("b"), i8));
+  $ ASSERT_TRUE(row.getValue(table.getColumn("b"), i16));
+  $ ASSERT_EQ(i16, -129);
+  $ ASSERT_FALSE(row.getValue(table.getColumn("c"), u16));
+}
+
+TEST(CSVTable, allocator) {
+  struct Counter {
+    atomic<size_t> allocations {0}, live {0};
+
+    static void *alloc(size_t size, void *context) {
+      Counter *self = static_cast<Counter *>(context);
+      ++self->allocations;
+      ++self->live;
+      return malloc(size);
+    }
+
+    static void *reallocate(void *ptr, size_t size, void *context) {
+      Counter *self = static_cast<Counter *>(context);
+      if (ptr == nullptr) {
+        ++self->allocations;
+        ++self->live;
+      }
+      return realloc(ptr, size);
+    }
+
+    static void release(void *ptr, void *context) {
+      --static_cast<Counter *>(context)->live;
+      free(ptr);
+    }
+  } counter;
+  csv_allocator allocator {&Counter::alloc, &Counter::reallocate, &Counter::release, &counter};
+
+  string parallel_data = "a,b\n";
+  for (size_t i = 0; parallel_data.size() < LIBCSV_PARALLEL_MIN_LENGTH * 4; ++i) {
+    parallel_data += to_string(i) + ",\"" + to_string(i * 7) + "\"\n";
+  }
+
+  {
+    CSVTable table {allocator};
+    $ ASSERT_TRUE(table.mapFile(mlb_players_path));
+    $ ASSERT_TRUE(table.nextRow());
+    table.projectColumns({0});
+    table.addData(mlb_players.substr(mlb_players.find('\n') + 1));
+
+    CSVTable batches {allocator};
+    batches.addData("a,b\n1,2\n3,4\n");
+    $ ASSERT_TRUE(batches.setBatchSize(4));
+    batches.addData("5,6\n");
+    batches.flushBatch();
+    CSVBatch batch = batches.nextBatch();
+    $ ASSERT_TRUE(batch);
+
+    CSVTable channel {allocator};
+    CSVChannel rows = channel.getChannel();
+    channel.addData(mlb_players);
+    rows.close();
+    $ ASSERT_TRUE(rows.nextRow());
+
+    CSVTable parallel {allocator};
+    parallel.setThreadCount(4);
+    parallel.addData(parallel_data);
+    $ ASSERT_EQ(parallel.availableRows(), count(parallel_data.begin(), parallel_data.end(), '\n') - 1);
+
+    /* Halfway value with too many digits is converted by the slow path, which copies it */
+    string long_value = "9007199254740993." + string(150, '0') + "1";
+    CSVTable numbers {allocator};
+    numbers.addData("a,b\n");
+    $ ASSERT_TRUE(numbers.setColumnType(numbers.getColumn("b"), CSV_TYPE_DOUBLE));
+    numbers.addData(long_value + "," + long_value + "\n");
+    CSVRow row = numbers.nextRow();
+    double value;
+    size_t allocations = counter.allocations;
+    $ ASSERT_TRUE(row.getValue(numbers.getColumn("a"), value));
+    $ ASSERT_EQ(value, 9007199254740994.0);
+    $ ASSERT_EQ(counter.allocations, allocations + 1);
+    $ ASSERT_TRUE(row.getValue(numbers.getColumn("b"), value));
+    $ ASSERT_EQ(value, 9007199254740994.0);
+
+    string output;
+    allocations = counter.allocations;
+    CSVWriter writer {[&](const char *data, size_t length) {
+      output.append(data, length);
+      return true;
+    }, allocator};
+    $ ASSERT_GT(counter.allocations, allocations);
+    writer.writeRow(row);
+    writer.flush();
+    $ ASSERT_EQ(output, long_value + ",9007199254740994\n");
+  }
+
+  $ ASSERT_GT(counter.allocations.load(), 0);
+  $ ASSERT_EQ(counter.live.load(), 0);
+}
+
+TEST(CSVTable, seek_row) {
+  string data = "id,value\n";
+  for (size_t i = 0; i < 10000; ++i) {
+    data += to_string(i);
+    if (i % 7 == 0) {
+      data += ",\"multi\nline " + to_string(i) + "\"\r\n";
+    } else if (i == 7001) {
+      data += ",\"broken\"x\n";
+    } else {
+      data += ",value " + to_string(i) + "\n";
+    }
+  }
+
+  CSVTable table;
+  $ ASSERT_TRUE(table.setIndexInterval(100));
+  $ ASSERT_FALSE(table.seekRow(0));
+  table.addDataRetained(data.data(), data.size(), nullptr, nullptr);
+  $ ASSERT_FALSE(table.setIndexInterval(10));
+  $ ASSERT_EQ(table.getIndexSize(), 101);
+  $ ASSERT_EQ(table.availableRows(), 10000);
+
+  CSVError error;
+  $ ASSERT_TRUE(table.getError(error));
+  size_t error_line = error.line;
+  $ ASSERT_FALSE(table.getError(error));
+
+  CSVColumn id = table.getColumn("id"), value = table.getColumn("value");
+  for (size_t n : {5000, 0, 9999, 7000, 101}) {
+    $ ASSERT_TRUE(table.seekRow(n));
+    $ ASSERT_EQ(table.availableRows(), 10000 - n);
+
+    CSVRow row = table.nextRow();
+    $ ASSERT_EQ(row.getIndex(), n);
+    $ ASSERT_EQ(row.getValue(id), to_string(n));
+    $ ASSERT_EQ(row.getValue(value), (n % 7 == 0 ? "multi\nline " : "value ") + to_string(n));
+  }
+
+  /* Line of the error is the same as after parsing from the beginning */
+  $ ASSERT_TRUE(table.seekRow(6950));
+  $ ASSERT_TRUE(table.getError(error));
+  $ ASSERT_EQ(error.line, error_line);
+
+  table.setMaxQueuedRows(10);
+  $ ASSERT_TRUE(table.seekRow(1234));
+  $ ASSERT_EQ(table.availableRows(), 10);
+  $ ASSERT_EQ(table.resume(), 0);
+  $ ASSERT_EQ(table.nextRow().getIndex(), 1234);
+  while (table.nextRow()) {
+  }
+  $ ASSERT_GT(table.resume(), 0);
+  $ ASSERT_EQ(table.nextRow().getValue(id), "1244");
+  $ ASSERT_EQ(table.getIndexSize(), 101);
+
+  CSVTable players;
+  $ ASSERT_FALSE(players.seekRow(0));
+  $ ASSERT_TRUE(players.setIndexInterval(64));
+  $ ASSERT_TRUE(players.mapFile(mlb_players_path));
+  $ ASSERT_EQ(players.getIndexSize(), 1034 / 64 + 1);
+
+  vector<string> names;
+  while (CSVRow row = players.nextRow()) {
+    names.push_back(row.getValue(players.getColumn("Name")));
+  }
+  $ ASSERT_TRUE(players.seekRow(500));
+  $ ASSERT_EQ(players.nextRow().getValue(players.getColumn("Name")), names[500]);
+  $ ASSERT_FALSE(players.seekRow(1034) && players.nextRow());
+}
+
+TEST(CSVTable, sidecar_index) {
+  string path = testing::TempDir() + "libcsv_sidecar.csv", index_path = path + ".index";
+  remove(index_path.c_str());
+
+  auto write = [&](size_t rows) {
+    ofstream stream(path, ios::binary | ios::trunc);
+    stream << "id,\"na,me\"\n";
+    for (size_t i = 0; i < rows; ++i) {
+      stream << i << ",\"name\n" << i << "\"\n";
+    }
+  };
+  auto open = [&](size_t interval, size_t n, size_t rows) {
+    CSVTable table;
+    table.setIndexInterval(interval);
+    table.setMaxQueuedRows(4);
+    $ ASSERT_TRUE(table.mapFileIndexed(path, index_path));
+    $ ASSERT_EQ(table.availableRows(), 0);
+    $ ASSERT_TRUE(table.seekRow(n));
+    $ ASSERT_EQ(table.availableRows(), min<size_t>(4, rows - n));
+
+    CSVRow row = table.nextRow();
+    $ ASSERT_EQ(row.getIndex(), n);
+    $ ASSERT_EQ(row.getValue(table.getColumn("id")), to_string(n));
+    $ ASSERT_EQ(row.getValue(table.getColumn("na,me")), "name\n" + to_string(n));
+    $ ASSERT_EQ(table.getIndexRows(), rows);
+  };
+  auto index_size = [&]() {
+    ifstream stream(index_path, ios::binary | ios::ate);
+    return stream ? static_cast<size_t>(stream.tellg()) : 0;
+  };
+
+  write(5000);
+  open(100, 4321, 5000);
+  size_t size = index_size();
+  $ ASSERT_GT(size, 51 * 16);
+
+  /* The sidecar is loaded, so rows are known without parsing */
+  {
+    CSVTable table;
+    $ ASSERT_TRUE(table.mapFileIndexed(path, index_path));
+    $ ASSERT_EQ(table.getIndexInterval(), 100);
+    $ ASSERT_EQ(table.getIndexRows(), 5000);
+    $ ASSERT_EQ(table.getIndexSize(), 51);
+    $ ASSERT_EQ(table.getColumnCount(), 2);
+    $ ASSERT_EQ(table.availableRows(), 0);
+    $ ASSERT_GT(table.resume(), 0);
+    $ ASSERT_EQ(table.nextRow().getValue(table.getColumn("id")), "0");
+  }
+  open(100, 17, 5000);
+
+  /* Stale sidecar is rebuilt */
+  write(7000);
+  open(100, 6999, 7000);
+  $ ASSERT_GT(index_size(), size);
+  open(0, 6000, 7000);
+
+  /* So is the one of another interval or a broken one */
+  open(1000, 10, 7000);
+  size = index_size();
+  $ ASSERT_EQ(size % 8, 0);
+  {
+    ofstream stream(index_path, ios::binary | ios::in | ios::out);
+    stream << "X";
+  }
+  open(1000, 2500, 7000);
+  $ ASSERT_EQ(index_size(), size);
+  {
+    CSVTable table;
+    $ ASSERT_TRUE(table.mapFileIndexed(path, index_path));
+    $ ASSERT_EQ(table.getIndexInterval(), 1000);
+  }
+
+  /* Checkpoint outside of the file (the first one of 8 here) */
+  {
+    uint64_t offset = UINT64_C(1) << 40;
+    fstream stream(index_path, ios::binary | ios::in | ios::out);
+    stream.seekp(size - 8 * 16);
+    stream.write(reinterpret_cast<const char *>(&offset), sizeof(offset));
+  }
+  open(1000, 5, 7000);
+  $ ASSERT_EQ(index_size(), size);
+  {
+    CSVTable table;
+    $ ASSERT_TRUE(table.mapFileIndexed(path, index_path));
+    $ ASSERT_EQ(table.getIndexSize(), 8);
+    $ ASSERT_GT(table.resume(), 0);
+  }
+
+  CSVTable table;
+  table.addData("a\n");
+  $ ASSERT_FALSE(table.mapFileIndexed(path, index_path));
+
+  remove(path.c_str());
+  remove(index_path.c_str());
+}
+
+TEST(CSVFollower, follow) {
+  string path = testing::TempDir() + "libcsv_follow.csv";
+  auto append = [&](const string &data) {
+    ofstream stream(path, ios::binary | ios::app);
+    stream << data;
+  };
+  auto values = [](CSVTable &table) {
+    vector<string> result;
+    while (CSVRow row = table.nextRow()) {
+      result.push_back(row.getValue(table.getColumn("id")) + "=" + row.getValue(table.getColumn("value")));
+    }
+    return result;
+  };
+
+  remove(path.c_str());
+  CSVTable table;
+  $ ASSERT_FALSE(table.follow(path));
+
+  append("id,value\n1,a\n2,b\n");
+  CSVFollower follower = table.follow(path);
+  $ ASSERT_TRUE(follower);
+  $ ASSERT_EQ(follower.poll(0), 17);
+  $ ASSERT_EQ(values(table), vector<string>({"1=a", "2=b"}));
+  $ ASSERT_EQ(follower.poll(10), 0);
+
+  /* Only complete rows are delivered */
+  append("3,c");
+  $ ASSERT_EQ(follower.poll(0), 3);
+  $ ASSERT_TRUE(values(table).empty());
+  append("cc\n");
+  $ ASSERT_EQ(follower.poll(0), 3);
+  $ ASSERT_EQ(values(table), vector<string>({"3=ccc"}));
+
+  /* Waiting poll wakes up once data is appended */
+  thread writer([&]() {
+    this_thread::sleep_for(chrono::milliseconds(50));
+    append("4,d\n");
+  });
+  $ ASSERT_EQ(follower.poll(10000), 4);
+  writer.join();
+  $ ASSERT_EQ(values(table), vector<string>({"4=d"}));
+
+  /* Truncated file is read from the beginning, its header is skipped and the partial row is dropped */
+  append("5,");
+  $ ASSERT_EQ(follower.poll(0), 2);
+  {
+    ofstream stream(path, ios::binary | ios::trunc);
+    stream << "id,value\n";
+  }
+  append("6,f\n");
+  $ ASSERT_GT(follower.poll(0), 0);
+  $ ASSERT_EQ(values(table), vector<string>({"6=f"}));
+
+  /* The same if file is rewritten before it is read, even if it is not shorter than the read data */
+  {
+    ofstream stream(path, ios::binary | ios::trunc);
+    stream << "id,value\n60,ff\n61,gg\n";
+  }
+  $ ASSERT_GT(follower.poll(0), 0);
+  $ ASSERT_EQ(values(table), vector<string>({"60=ff", "61=gg"}));
+
+  /* Rotated file is read up to its end, then the new one is followed */
+  append("7,g\n");
+  $ ASSERT_EQ(rename(path.c_str(), (path + ".1").c_str()), 0);
+  append("id,value\n8,h\n");
+  $ ASSERT_GT(follower.poll(0), 0);
+  $ ASSERT_EQ(values(table), vector<string>({"7=g", "8=h"}));
+
+  /* The same once the new file appears later */
+  $ ASSERT_EQ(rename(path.c_str(), (path + ".1").c_str()), 0);
+  thread rotator([&]() {
+    this_thread::sleep_for(chrono::milliseconds(50));
+    append("id,value\n9,i\n");
+  });
+  $ ASSERT_GT(follower.poll(10000), 0);
+  rotator.join();
+  $ ASSERT_EQ(values(table), vector<string>({"9=i"}));
+
+  thread stopper([&]() {
+    this_thread::sleep_for(chrono::milliseconds(50));
+    follower.stop();
+  });
+  $ ASSERT_EQ(follower.poll(), 0);
+  stopper.join();
+  append("10,j\n");
+  $ ASSERT_EQ(follower.poll(0), 0);
+
+  remove(path.c_str());
+  remove((path + ".1").c_str());
+}
+
+TEST(CSVArena, reset) {
+  CSVArena arena {64 * 1024};
+  $ ASSERT_EQ(arena.getUsed(), 0);
+
+  size_t capacity = 0;
+  for (size_t round = 0; round < 3; ++round) {
+    {
+      CSVTable table {arena};
+      table.addData(mlb_players);
+      $ ASSERT_EQ(table.availableRows(), 1034);
+
+      CSVRow row = table.nextRow();
+      $ ASSERT_EQ(row.getValue(table.getColumn("Name")), "Adam Donachie");
+      $ ASSERT_EQ(row.getValue(table.getColumn("Weight(lbs)")), "180");
+    }
+
+    $ ASSERT_GT(arena.getUsed(), 0);
+    $ ASSERT_GE(arena.getCapacity(), arena.getUsed());
+    if (round == 0) {
+      capacity = arena.getCapacity();
+    }
+    /* Blocks are reused after reset */
+    $ ASSERT_EQ(arena.getCapacity(), capacity);
+
+    arena.reset();
+    $ ASSERT_EQ(arena.getUsed(), 0);
+  }
+
+  csv_allocator allocator = arena.getAllocator();
+  char *small = static_cast<char *>(allocator.alloc(10, allocator.context));
+  memcpy(small, "0123456789", 10);
+  char *grown = static_cast<char *>(allocator.realloc(small, 1000, allocator.context));
+  $ ASSERT_EQ(grown, small);
+  char *large = static_cast<char *>(allocator.alloc(1024 * 1024, allocator.context));
+  $ ASSERT_NE(large, nullptr);
+  char *moved = static_cast<char *>(allocator.realloc(grown, 2000, allocator.context));
+  $ ASSERT_NE(moved, grown);
+  $ ASSERT_EQ(string(moved, 10), "0123456789");
+  $ ASSERT_EQ(reinterpret_cast<uintptr_t>(moved) % 16, 0);
+  allocator.free(moved, allocator.context);
+  $ ASSERT_GE(arena.getCapacity(), capacity + 1024 * 1024);
+}
+
+
 void read_file(string name, string &out) {
   ifstream stream(move(name));
 
@@ -630,7 +2370,8 @@ int main(int argc, char **argv) {
     data_path += "/../data";
   }
 
-  read_file(data_path + "/mlb_players.csv", mlb_players);
+  mlb_players_path = data_path + "/mlb_players.csv";
+  read_file(mlb_players_path, mlb_players);
 
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();